@@ -0,0 +1,103 @@
+#include "asynccqueue.h"
+
+OrderExecutor::~OrderExecutor() {
+    for (set<void*>::iterator it = m_tasks.begin(); it != m_tasks.end(); it++) {
+        coroutine_handle<>::from_address(*it).destroy();
+    }
+}
+void OrderExecutor::spawn(DispatchTask task) {
+    coroutine_handle<> handle = task.release();
+    m_tasks.insert(handle.address());
+    m_ready.push_back(handle);
+}
+void OrderExecutor::schedule(coroutine_handle<> handle) {
+    m_ready.push_back(handle);
+}
+long long OrderExecutor::run() {
+    long long resumed = 0;
+    while (!m_ready.empty()) {
+        coroutine_handle<> handle = m_ready.front();
+        m_ready.pop_front();
+        resumed += 1;
+        try {
+            handle.resume();
+        }
+        catch (...) { // the coroutine ended with the exception
+            m_tasks.erase(handle.address());
+            handle.destroy();
+            throw;
+        }
+        if (handle.done()) {
+            m_tasks.erase(handle.address());
+            handle.destroy();
+        }
+    }
+    return resumed;
+}
+int OrderExecutor::tasks() const {
+    return (int)m_tasks.size();
+}
+
+AsyncCQueue::AsyncCQueue(OrderExecutor& executor, prifn_t priFn, HEAPTYPE heapType,
+                         STRUCTURE structure, int capacity)
+    : m_executor(executor), m_queue(priFn, heapType, structure), m_capacity(capacity) {
+}
+void AsyncCQueue::NextOrderAwaiter::await_suspend(coroutine_handle<> handle) {
+    m_handle = handle;
+    m_queue.m_consumers.push_back(this);
+}
+Order AsyncCQueue::NextOrderAwaiter::await_resume() {
+    if (m_ready) {
+        return m_order;
+    }
+    return m_queue.pop();
+}
+void AsyncCQueue::InsertAwaiter::await_suspend(coroutine_handle<> handle) {
+    m_handle = handle;
+    m_queue.m_producers.push_back(this);
+}
+ADMISSION AsyncCQueue::InsertAwaiter::await_resume() {
+    if (!m_done) {
+        m_status = m_queue.push(m_order);
+    }
+    return m_status;
+}
+bool AsyncCQueue::tryInsert(const Order& order) {
+    if (full()) {
+        return false;
+    }
+    return push(order) == ADMITTED;
+}
+int AsyncCQueue::numOrders() const {
+    return m_queue.numOrders();
+}
+int AsyncCQueue::capacity() const {
+    return m_capacity;
+}
+// producers already waiting go first, a new one may not overtake them
+bool AsyncCQueue::full() const {
+    return m_capacity > 0 && (m_queue.numOrders() >= m_capacity || !m_producers.empty());
+}
+ADMISSION AsyncCQueue::push(const Order& order) {
+    ADMISSION status = m_queue.insertOrder(order);
+    if (!m_consumers.empty() && m_queue.numOrders() > 0) {
+        NextOrderAwaiter *consumer = m_consumers.front();
+        m_consumers.pop_front();
+        consumer->m_order = m_queue.getNextOrder();
+        consumer->m_ready = true;
+        m_executor.schedule(consumer->m_handle);
+    }
+    return status;
+}
+Order AsyncCQueue::pop() {
+    Order order = m_queue.getNextOrder();
+    // a rejected order leaves the room free, so the next producer is let in
+    while (!m_producers.empty() && m_queue.numOrders() < m_capacity) {
+        InsertAwaiter *producer = m_producers.front();
+        m_producers.pop_front();
+        producer->m_status = m_queue.insertOrder(producer->m_order); // a rejection goes back to the producer
+        producer->m_done = true;
+        m_executor.schedule(producer->m_handle);
+    }
+    return order;
+}
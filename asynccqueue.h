@@ -0,0 +1,119 @@
+#ifndef ASYNCCQUEUE_H
+#define ASYNCCQUEUE_H
+#include "cqueue.h"
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <set>
+// Needs C++20 for the coroutines.
+
+class DispatchTask{
+    // a coroutine started and owned by an OrderExecutor
+public:
+    class promise_type{
+    public:
+        DispatchTask get_return_object() {
+            return DispatchTask(coroutine_handle<promise_type>::from_promise(*this));
+        }
+        suspend_always initial_suspend() noexcept {return suspend_always();}
+        suspend_always final_suspend() noexcept {return suspend_always();}
+        void return_void() {}
+        void unhandled_exception() {throw;} // surfaces from OrderExecutor::run()
+    };
+    explicit DispatchTask(coroutine_handle<promise_type> handle) : m_handle(handle) {}
+    DispatchTask(DispatchTask&& rhs) noexcept : m_handle(rhs.m_handle) {rhs.m_handle = nullptr;}
+    DispatchTask(const DispatchTask&) = delete;
+    DispatchTask& operator=(const DispatchTask&) = delete;
+    ~DispatchTask() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+    coroutine_handle<> release() { // hands the frame over to the executor
+        coroutine_handle<> handle = m_handle;
+        m_handle = nullptr;
+        return handle;
+    }
+
+private:
+    coroutine_handle<promise_type> m_handle;
+};
+
+class OrderExecutor{
+    // single-threaded run loop that resumes coroutines in FIFO order
+public:
+    OrderExecutor() {}
+    ~OrderExecutor(); // destroys coroutines that never finished
+    OrderExecutor(const OrderExecutor&) = delete;
+    OrderExecutor& operator=(const OrderExecutor&) = delete;
+    void spawn(DispatchTask task);
+    void schedule(coroutine_handle<> handle);
+    // resumes coroutines until none is runnable, returns how many were resumed
+    long long run();
+    int tasks() const; // coroutines spawned and not finished yet
+
+private:
+    deque<coroutine_handle<> > m_ready;
+    set<void*> m_tasks; // frame addresses of the live coroutines
+};
+
+class AsyncCQueue{
+    // A CQueue for coroutines of one OrderExecutor. nextOrder() suspends
+    // while the queue is empty and insert() suspends while it is full, both
+    // are woken in FIFO order. Waiting consumers only exist while the queue
+    // is empty and waiting producers only while it is full.
+public:
+    // capacity 0 means unbounded, so insert() never suspends
+    AsyncCQueue(OrderExecutor& executor, prifn_t priFn, HEAPTYPE heapType,
+                STRUCTURE structure, int capacity = 0);
+    AsyncCQueue(const AsyncCQueue&) = delete;
+    AsyncCQueue& operator=(const AsyncCQueue&) = delete;
+
+    class NextOrderAwaiter{
+    public:
+        explicit NextOrderAwaiter(AsyncCQueue& queue) : m_queue(queue), m_ready(false) {}
+        bool await_ready() {return m_queue.m_queue.numOrders() > 0;}
+        void await_suspend(coroutine_handle<> handle);
+        Order await_resume();
+    private:
+        friend class AsyncCQueue;
+        AsyncCQueue& m_queue;
+        coroutine_handle<> m_handle;
+        Order m_order;  // handed over by the producer that woke us
+        bool m_ready;
+    };
+    class InsertAwaiter{
+    public:
+        InsertAwaiter(AsyncCQueue& queue, const Order& order)
+            : m_queue(queue), m_order(order), m_done(false), m_status(ADMITTED) {}
+        bool await_ready() {return !m_queue.full();}
+        void await_suspend(coroutine_handle<> handle);
+        ADMISSION await_resume(); // what the queue said to the order
+    private:
+        friend class AsyncCQueue;
+        AsyncCQueue& m_queue;
+        coroutine_handle<> m_handle;
+        Order m_order;
+        bool m_done;    // inserted by the consumer that made room
+        ADMISSION m_status; // set along with m_done
+    };
+    NextOrderAwaiter nextOrder() {return NextOrderAwaiter(*this);} // co_await queue.nextOrder()
+    // co_await queue.insert(order), evaluates to the ADMISSION of the order
+    InsertAwaiter insert(const Order& order) {return InsertAwaiter(*this, order);}
+    // for callers outside coroutines, false when full or the order was not admitted
+    bool tryInsert(const Order& order);
+    int numOrders() const;
+    int capacity() const;
+
+private:
+    bool full() const;
+    ADMISSION push(const Order& order); // inserts and hands the best order to a waiting consumer
+    Order pop();                   // removes the best order and admits waiting producers until one fits
+
+    OrderExecutor& m_executor;
+    CQueue m_queue;
+    int m_capacity;
+    deque<NextOrderAwaiter*> m_consumers;
+    deque<InsertAwaiter*> m_producers;
+};
+#endif
@@ -0,0 +1,583 @@
+// Benchmarks, build separately from the tester:
+//   g++ -std=c++20 -O2 -pthread bench.cpp cqueue.cpp cqmetrics.cpp threadpool.cpp asynccqueue.cpp
+//       partitionedcqueue.cpp orderbatch.cpp orderstore.cpp persistentcqueue.cpp
+//       nodepool.cpp -o bench
+//   ./bench [benchmark] [orders]
+// The scaling tables run from 1 to thread::hardware_concurrency() threads.
+// On a single core machine they have one row, the thread pool is empty and
+// the parallel paths never run, so those numbers only show the sequential
+// cost. The numbers quoted in the history so far were measured that way.
+#include "cqueue.h"
+#include "threadpool.h"
+#include "asynccqueue.h"
+#include "partitionedcqueue.h"
+#include "persistentcqueue.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+int priorityFn1(const Order &order);// works with a MAXHEAP
+int priorityFn2(const Order &order);// works with a MINHEAP
+
+// random orders with valid IDs, the same sequence every run
+vector<Order> makeOrders(int count, unsigned int seed = 10) {
+    mt19937 generator(seed);
+    uniform_int_distribution<int> item(0, 5);
+    uniform_int_distribution<int> quantity(0, 3);
+    uniform_int_distribution<int> tier(0, 5);
+    uniform_int_distribution<int> points(MINPOINTS, MAXPOINTS);
+    uniform_int_distribution<int> customer(MINCUSTID, MAXCUSTID);
+    uniform_int_distribution<int> orderID(MINORDERID, MAXORDERID);
+    vector<Order> orders;
+    orders.reserve(count);
+    for (int i = 0; i < count; i++) {
+        orders.push_back(Order(static_cast<ITEM>(item(generator)),
+                               static_cast<COUNT>(quantity(generator)),
+                               static_cast<MEMBERSHIP>(tier(generator)),
+                               points(generator), customer(generator), orderID(generator)));
+    }
+    return orders;
+}
+double millisSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+int hardwareThreads() {
+    return thread::hardware_concurrency() > 0 ? (int)thread::hardware_concurrency() : 1;
+}
+// below a scaling table, so a one row table is not read as a result
+void noteSingleCore() {
+    if (hardwareThreads() == 1) {
+        cout << "(one hardware thread, the parallel path did not run)" << endl;
+    }
+}
+
+// setPriorityFn rebuild time for 1 .. N threads
+void benchRebuild(int count) {
+    vector<Order> orders = makeOrders(count);
+    cout << "rebuild of " << count << " orders (setPriorityFn, leftist)" << endl;
+    cout << "threads\tms\tspeedup" << endl;
+    double single = 0;
+    for (int threads = 1; threads <= hardwareThreads(); threads++) {
+        ThreadPool::shared().resize(threads - 1);
+        CQueue queue(priorityFn2, MINHEAP, LEFTIST);
+        for (int i = 0; i < count; i++) {
+            queue.insertOrder(orders[i]);
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        queue.setPriorityFn(priorityFn1, MAXHEAP);
+        double millis = millisSince(start);
+        if (threads == 1) {
+            single = millis;
+        }
+        cout << threads << "\t" << millis << "\t" << single / millis << endl;
+    }
+    noteSingleCore();
+}
+
+// N store backlogs: serial insert + mergeWithQueue against bulkLoad on 1 .. N threads
+void benchBulkLoad(int count) {
+    int stores = 8;
+    vector<vector<Order> > backlogs(stores);
+    for (int b = 0; b < stores; b++) {
+        backlogs[b] = makeOrders(count / stores, 10 + b);
+    }
+    cout << "load of " << stores << " backlogs, " << count << " orders (leftist)" << endl;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    CQueue serial(priorityFn1, MAXHEAP, LEFTIST);
+    for (int b = 0; b < stores; b++) {
+        CQueue store(priorityFn1, MAXHEAP, LEFTIST);
+        for (unsigned int i = 0; i < backlogs[b].size(); i++) {
+            store.insertOrder(backlogs[b][i]);
+        }
+        serial.mergeWithQueue(store);
+    }
+    double serialMillis = millisSince(start);
+    cout << "serial insert + merge\t" << serialMillis << " ms" << endl;
+    cout << "threads\tms\tspeedup" << endl;
+    for (int threads = 1; threads <= hardwareThreads(); threads++) {
+        ThreadPool::shared().resize(threads - 1);
+        CQueue queue(priorityFn1, MAXHEAP, LEFTIST);
+        start = chrono::steady_clock::now();
+        queue.bulkLoad(backlogs);
+        double millis = millisSince(start);
+        cout << threads << "\t" << millis << "\t" << serialMillis / millis << endl;
+    }
+    noteSingleCore();
+}
+
+DispatchTask benchStation(AsyncCQueue& queue, int orders, long long& checksum) {
+    for (int i = 0; i < orders; i++) {
+        Order order = co_await queue.nextOrder();
+        checksum += order.getOrderID();
+    }
+}
+DispatchTask benchRegister(AsyncCQueue& queue, const vector<Order>& orders) {
+    for (unsigned int i = 0; i < orders.size(); i++) {
+        co_await queue.insert(orders[i]);
+    }
+}
+// thousands of station coroutines over one bounded queue, compared with
+// plain insertOrder/getNextOrder calls on the same orders
+void benchAsync(int count) {
+    int stations = 1000;
+    count = count / stations * stations;
+    vector<Order> orders = makeOrders(count);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    CQueue plain(priorityFn2, MINHEAP, SKEW);
+    long long plainSum = 0;
+    for (int i = 0; i < count; i++) {
+        plain.insertOrder(orders[i]);
+        if (plain.numOrders() == 1024) {
+            plainSum += plain.getNextOrder().getOrderID();
+        }
+    }
+    while (plain.numOrders() > 0) {
+        plainSum += plain.getNextOrder().getOrderID();
+    }
+    double plainMillis = millisSince(start);
+
+    OrderExecutor executor;
+    AsyncCQueue queue(executor, priorityFn2, MINHEAP, SKEW, 1024);
+    long long asyncSum = 0;
+    start = chrono::steady_clock::now();
+    for (int s = 0; s < stations; s++) {
+        executor.spawn(benchStation(queue, count / stations, asyncSum));
+    }
+    executor.spawn(benchRegister(queue, orders));
+    long long resumed = executor.run();
+    double asyncMillis = millisSince(start);
+    cout << "async dispatch of " << count << " orders to " << stations << " stations (capacity 1024)" << endl;
+    cout << "plain CQueue\t" << plainMillis * 1e6 / count << " ns/order" << endl;
+    cout << "coroutines\t" << asyncMillis * 1e6 / count << " ns/order, "
+         << resumed << " resumptions" << (plainSum == asyncSum ? "" : " CHECKSUM MISMATCH") << endl;
+}
+
+// prints throughput and how evenly the stations shared the work
+void reportStations(const char *name, int count, double millis, const vector<int>& handled,
+                    unsigned long long stolen) {
+    int fewest = *min_element(handled.begin(), handled.end());
+    int most = *max_element(handled.begin(), handled.end());
+    cout << name << "\t" << millis << "\t" << count / millis << "\t"
+         << fewest << "/" << most << "\t" << 100.0 * stolen / count << endl;
+}
+// stations draining one shared locked CQueue against a queue partitioned by item
+void benchPartition(int count) {
+    vector<Order> orders = makeOrders(count);
+    cout << "drain of " << count << " orders by N stations (leftist)" << endl;
+    cout << "stations\tqueue\tms\torders/ms\tfewest/most\tstolen %" << endl;
+    int stationCounts[] = {1, 2, 3, 6};
+    for (int s = 0; s < 4; s++) {
+        int stations = stationCounts[s];
+        CQueue shared(priorityFn1, MAXHEAP, LEFTIST);
+        for (int i = 0; i < count; i++) {
+            shared.insertOrder(orders[i]);
+        }
+        mutex lock;
+        vector<int> handled(stations, 0);
+        vector<thread> threads;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int t = 0; t < stations; t++) {
+            threads.push_back(thread([&, t] {
+                while (true) {
+                    lock_guard<mutex> guard(lock);
+                    if (shared.numOrders() == 0) {
+                        return;
+                    }
+                    shared.getNextOrder();
+                    handled[t] += 1;
+                }
+            }));
+        }
+        for (int t = 0; t < stations; t++) {
+            threads[t].join();
+        }
+        cout << stations << "\t";
+        reportStations("shared", count, millisSince(start), handled, 0);
+
+        PartitionedCQueue partitioned(priorityFn1, MAXHEAP, LEFTIST, stations);
+        for (int i = 0; i < count; i++) {
+            partitioned.insertOrder(orders[i]);
+        }
+        handled.assign(stations, 0);
+        threads.clear();
+        start = chrono::steady_clock::now();
+        for (int t = 0; t < stations; t++) {
+            threads.push_back(thread([&, t] {
+                Order order;
+                while (partitioned.getNextOrder(t, order)) {
+                    handled[t] += 1;
+                }
+            }));
+        }
+        for (int t = 0; t < stations; t++) {
+            threads[t].join();
+        }
+        double millis = millisSince(start);
+        unsigned long long stolen = 0;
+        for (int t = 0; t < stations; t++) {
+            stolen += partitioned.stolen(t);
+        }
+        cout << stations << "\t";
+        reportStations("partitioned", count, millis, handled, stolen);
+    }
+}
+
+// per-order prifn_t calls against batch evaluation of a compiled table over
+// columns, then the same two ways through bulkLoad and the setPriorityFn rebuild
+void benchBatch(int count) {
+    vector<Order> orders = makeOrders(count);
+    OrderBatch batch(orders);
+    constexpr PriorityTable table1 = PriorityModel().setCountWeight(1).setPointsWeight(1).compile();
+    constexpr PriorityTable table2 = PriorityModel().setItemWeight(1).setTierWeight(1).compile();
+    vector<int> priorities(count);
+    cout << "priorities of " << count << " orders" << endl;
+    prifn_t volatile fn = priorityFn1; // keeps the call indirect like in CQueue
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        priorities[i] = fn(orders[i]);
+    }
+    double fnMillis = millisSince(start);
+    long long fnSum = 0;
+    for (int i = 0; i < count; i++) {
+        fnSum += priorities[i];
+    }
+    start = chrono::steady_clock::now();
+    table1.evaluate(batch, 0, count, priorities.data());
+    double tableMillis = millisSince(start);
+    long long tableSum = 0;
+    for (int i = 0; i < count; i++) {
+        tableSum += priorities[i];
+    }
+    cout << "prifn_t per order\t" << fnMillis << " ms" << endl;
+    cout << "table over columns\t" << tableMillis << " ms" << (fnSum == tableSum ? "" : " CHECKSUM MISMATCH") << endl;
+
+    CQueue fnQueue(priorityFn2, MINHEAP, LEFTIST);
+    start = chrono::steady_clock::now();
+    fnQueue.bulkLoad(vector<vector<Order> >(1, orders));
+    double fnLoad = millisSince(start);
+    CQueue tableQueue(table2, MINHEAP, LEFTIST);
+    start = chrono::steady_clock::now();
+    tableQueue.bulkLoad(batch);
+    double tableLoad = millisSince(start);
+    cout << "bulkLoad, prifn_t backlog\t" << fnLoad << " ms" << endl;
+    cout << "bulkLoad, table batch\t" << tableLoad << " ms" << endl;
+    start = chrono::steady_clock::now();
+    fnQueue.setPriorityFn(priorityFn1, MAXHEAP);
+    double fnRebuild = millisSince(start);
+    start = chrono::steady_clock::now();
+    tableQueue.setPriorityFn(table1, MAXHEAP);
+    double tableRebuild = millisSince(start);
+    cout << "rebuild, prifn_t\t" << fnRebuild << " ms" << endl;
+    cout << "rebuild, table\t" << tableRebuild << " ms" << endl;
+}
+
+// the meld walks: inserting, merging two halves and draining the queue,
+// with the node size since that is what the walks pull into the cache
+void benchMeld(int count) {
+    vector<Order> orders = makeOrders(count);
+    cout << "melds over " << count << " orders, " << sizeof(Node) << " byte nodes" << endl;
+    cout << "structure\tinsert ms\tmerge ms\tdrain ms" << endl;
+    STRUCTURE structures[] = {SKEW, LEFTIST};
+    for (int s = 0; s < 2; s++) {
+        CQueue left(priorityFn1, MAXHEAP, structures[s]);
+        CQueue right(priorityFn1, MAXHEAP, structures[s]);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int i = 0; i < count; i++) {
+            (i % 2 == 0 ? left : right).insertOrder(orders[i]);
+        }
+        double insertMillis = millisSince(start);
+        start = chrono::steady_clock::now();
+        left.mergeWithQueue(right);
+        double mergeMillis = millisSince(start);
+        start = chrono::steady_clock::now();
+        long long checksum = 0;
+        while (left.numOrders() > 0) {
+            checksum += left.getNextOrder().getOrderID();
+        }
+        double drainMillis = millisSince(start);
+        cout << (structures[s] == SKEW ? "skew" : "leftist") << "\t" << insertMillis << "\t"
+             << mergeMillis << "\t" << drainMillis << (checksum > 0 ? "" : " EMPTY") << endl;
+    }
+}
+
+// the whole-heap traversals: copy constructor, a copy of that copy, whose
+// nodes are adjacent, clear and a rebuild
+void benchCopy(int count) {
+    vector<Order> orders = makeOrders(count);
+    cout << "traversals of " << count << " orders" << endl;
+    cout << "structure\tcopy ms\tcopy of copy ms\tclear ms\trebuild ms" << endl;
+    STRUCTURE structures[] = {SKEW, LEFTIST};
+    for (int s = 0; s < 2; s++) {
+        CQueue queue(priorityFn1, MAXHEAP, structures[s]);
+        for (int i = 0; i < count; i++) {
+            queue.insertOrder(orders[i]);
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        CQueue copy(queue);
+        double copyMillis = millisSince(start);
+        start = chrono::steady_clock::now();
+        CQueue second(copy);
+        double secondMillis = millisSince(start);
+        start = chrono::steady_clock::now();
+        copy.clear();
+        double clearMillis = millisSince(start);
+        start = chrono::steady_clock::now();
+        queue.setStructure(structures[1 - s]);
+        double rebuildMillis = millisSince(start);
+        cout << (structures[s] == SKEW ? "skew" : "leftist") << "\t" << copyMillis << "\t" << secondMillis
+             << "\t" << clearMillis << "\t" << rebuildMillis << endl;
+    }
+}
+
+// a reporting snapshot of a live queue: deep copy of a leftist CQueue
+// against the O(1) copy of a PersistentCQueue, then what the shared nodes
+// cost the writer that keeps going after the snapshot
+void benchSnapshot(int count) {
+    vector<Order> orders = makeOrders(count);
+    CQueue queue(priorityFn1, MAXHEAP, LEFTIST);
+    PersistentCQueue persistent(priorityFn1, MAXHEAP);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        queue.insertOrder(orders[i]);
+    }
+    double queueInsert = millisSince(start);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        persistent.insertOrder(orders[i]);
+    }
+    double persistentInsert = millisSince(start);
+    start = chrono::steady_clock::now();
+    CQueue queueCopy(queue);
+    double queueSnapshot = millisSince(start);
+    start = chrono::steady_clock::now();
+    PersistentCQueue persistentCopy(persistent);
+    double persistentSnapshot = millisSince(start);
+    int pops = count / 10;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < pops; i++) {
+        queue.getNextOrder();
+    }
+    double queuePops = millisSince(start);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < pops; i++) {
+        persistent.getNextOrder();
+    }
+    double persistentPops = millisSince(start);
+    cout << "snapshots of " << count << " orders, " << pops << " pops after the snapshot" << endl;
+    cout << "queue\tinsert ms\tsnapshot ms\tpops ms" << endl;
+    cout << "CQueue\t" << queueInsert << "\t" << queueSnapshot << "\t" << queuePops << endl;
+    cout << "PersistentCQueue\t" << persistentInsert << "\t" << persistentSnapshot << "\t" << persistentPops << endl;
+}
+
+// pop latency of a churned queue against the same queue after compact():
+// both get count inserts and count pop/insert rounds, then one is compacted
+// and both pop a tenth of their orders
+void benchCompact(int count) {
+    vector<Order> orders = makeOrders(2 * count);
+    int pops = count / 10;
+    cout << "compaction of " << count << " orders after " << count << " pop/insert rounds, "
+         << pops << " pops" << endl;
+    cout << "structure\tfragmentation\tcompact ms\tpops ms\tcompacted pops ms" << endl;
+    STRUCTURE structures[] = {SKEW, LEFTIST};
+    for (int s = 0; s < 2; s++) {
+        CQueue churned(priorityFn1, MAXHEAP, structures[s]);
+        CQueue compacted(priorityFn1, MAXHEAP, structures[s]);
+        CQueue *queues[] = {&churned, &compacted};
+        for (int q = 0; q < 2; q++) {
+            for (int i = 0; i < count; i++) {
+                queues[q]->insertOrder(orders[i]);
+            }
+            for (int i = count; i < 2 * count; i++) {
+                queues[q]->getNextOrder();
+                queues[q]->insertOrder(orders[i]);
+            }
+        }
+        double fragmentation = compacted.getFragmentation();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        compacted.compact();
+        double compactMillis = millisSince(start);
+        double millis[2];
+        long long checksum = 0;
+        for (int q = 0; q < 2; q++) {
+            start = chrono::steady_clock::now();
+            for (int i = 0; i < pops; i++) {
+                checksum += queues[q]->getNextOrder().getOrderID();
+            }
+            millis[q] = millisSince(start);
+        }
+        cout << (structures[s] == SKEW ? "skew" : "leftist") << "\t" << fragmentation << "\t"
+             << compactMillis << "\t" << millis[0] << "\t" << millis[1]
+             << (checksum > 0 ? "" : " EMPTY") << endl;
+    }
+}
+
+// k-way consolidation: k queues merged into the first one by mergeWithQueue,
+// eagerly and lazily, then the first pop (which consolidates a lazy queue)
+// and the drain of the rest
+void benchLazyMerge(int count) {
+    vector<Order> orders = makeOrders(count);
+    cout << "consolidation of " << count << " orders in k queues (leftist)" << endl;
+    cout << "k\tmode\tmerge ms\tfirst pop ms\tdrain ms" << endl;
+    int ways[] = {4, 16, 64, 256};
+    for (int w = 0; w < 4; w++) {
+        int k = ways[w];
+        for (int lazy = 0; lazy < 2; lazy++) {
+            vector<CQueue> queues(k, CQueue(priorityFn1, MAXHEAP, LEFTIST));
+            for (int i = 0; i < count; i++) {
+                queues[i % k].insertOrder(orders[i]);
+            }
+            queues[0].setLazyMerge(lazy == 1);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (int q = 1; q < k; q++) {
+                queues[0].mergeWithQueue(queues[q]);
+            }
+            double mergeMillis = millisSince(start);
+            start = chrono::steady_clock::now();
+            long long checksum = queues[0].getNextOrder().getOrderID();
+            double firstMillis = millisSince(start);
+            start = chrono::steady_clock::now();
+            while (queues[0].numOrders() > 0) {
+                checksum += queues[0].getNextOrder().getOrderID();
+            }
+            double drainMillis = millisSince(start);
+            cout << k << "\t" << (lazy == 1 ? "lazy" : "eager") << "\t" << mergeMillis << "\t"
+                 << firstMillis << "\t" << drainMillis << (checksum > 0 ? "" : " EMPTY") << endl;
+        }
+    }
+}
+
+// combining k store queues: k - 1 mergeWithQueue calls into the first
+// queue against mergeAll, sequential and on the pool, then a tenth of the
+// orders popped from the result
+void benchMergeAll(int count) {
+    vector<Order> orders = makeOrders(count);
+    int pops = count / 10;
+    cout << "combining " << count << " orders from k queues, " << pops << " pops after" << endl;
+    cout << "structure\tk\tmode\tmerge ms\tpops ms" << endl;
+    STRUCTURE structures[] = {SKEW, LEFTIST};
+    int ways[] = {64, 1024};
+    const char *modes[] = {"mergeWithQueue", "mergeAll", "mergeAll parallel"};
+    for (int s = 0; s < 2; s++) {
+        for (int w = 0; w < 2; w++) {
+            int k = ways[w];
+            for (int mode = 0; mode < 3; mode++) {
+                vector<CQueue> queues(k, CQueue(priorityFn1, MAXHEAP, structures[s]));
+                vector<CQueue*> pointers;
+                for (int q = 0; q < k; q++) {
+                    pointers.push_back(&queues[q]);
+                }
+                for (int i = 0; i < count; i++) {
+                    queues[i % k].insertOrder(orders[i]);
+                }
+                CQueue combined(priorityFn1, MAXHEAP, structures[s]);
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                if (mode == 0) {
+                    for (int q = 0; q < k; q++) {
+                        combined.mergeWithQueue(queues[q]);
+                    }
+                }
+                else {
+                    CQueue all = CQueue::mergeAll(span<CQueue*>(pointers), mode == 2);
+                    combined.mergeWithQueue(all);
+                }
+                double mergeMillis = millisSince(start);
+                start = chrono::steady_clock::now();
+                long long checksum = 0;
+                for (int i = 0; i < pops; i++) {
+                    checksum += combined.getNextOrder().getOrderID();
+                }
+                double popMillis = millisSince(start);
+                cout << (structures[s] == SKEW ? "skew" : "leftist") << "\t" << k << "\t" << modes[mode]
+                     << "\t" << mergeMillis << "\t" << popMillis << (checksum > 0 ? "" : " EMPTY") << endl;
+            }
+        }
+    }
+}
+
+// merging a skew MINHEAP queue on priorityFn2 into a leftist MAXHEAP queue
+// on priorityFn1 four times its size: draining it and inserting every
+// order against mergeWithQueue converting it
+void benchCrossMerge(int count) {
+    vector<Order> orders = makeOrders(count + count / 4);
+    cout << "cross-configuration merge of " << count / 4 << " orders into " << count << endl;
+    cout << "mode\tms" << endl;
+    for (int mode = 0; mode < 2; mode++) {
+        CQueue large(priorityFn1, MAXHEAP, LEFTIST);
+        CQueue small(priorityFn2, MINHEAP, SKEW);
+        for (int i = 0; i < count; i++) {
+            large.insertOrder(orders[i]);
+        }
+        for (int i = count; i < count + count / 4; i++) {
+            small.insertOrder(orders[i]);
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (mode == 0) {
+            while (small.numOrders() > 0) {
+                large.insertOrder(small.getNextOrder());
+            }
+        }
+        else {
+            large.mergeWithQueue(small);
+        }
+        double millis = millisSince(start);
+        cout << (mode == 0 ? "drain and insert" : "mergeWithQueue") << "\t" << millis
+             << (large.numOrders() == count + count / 4 ? "" : " LOST") << endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    string name = argc > 1 ? argv[1] : "all";
+    int count = argc > 2 ? atoi(argv[2]) : 1000000;
+    if (name == "rebuild" || name == "all") {
+        benchRebuild(count);
+    }
+    if (name == "bulkload" || name == "all") {
+        benchBulkLoad(count);
+    }
+    if (name == "async" || name == "all") {
+        benchAsync(count);
+    }
+    if (name == "partition" || name == "all") {
+        benchPartition(count);
+    }
+    if (name == "batch" || name == "all") {
+        benchBatch(count);
+    }
+    if (name == "meld" || name == "all") {
+        benchMeld(count);
+    }
+    if (name == "copy" || name == "all") {
+        benchCopy(count);
+    }
+    if (name == "snapshot" || name == "all") {
+        benchSnapshot(count);
+    }
+    if (name == "compact" || name == "all") {
+        benchCompact(count);
+    }
+    if (name == "lazymerge" || name == "all") {
+        benchLazyMerge(count);
+    }
+    if (name == "mergeall" || name == "all") {
+        benchMergeAll(count);
+    }
+    if (name == "crossmerge" || name == "all") {
+        benchCrossMerge(count);
+    }
+    return 0;
+}
+
+int priorityFn1(const Order &order) {
+    //this function works with a MAXHEAP
+    //priority value falls in the range [0-5003]
+    int priority = static_cast<int>(order.getCount()) + order.getPoints();
+    return priority;
+}
+
+int priorityFn2(const Order &order) {
+    //this funcction works with a MINHEAP
+    //priority value falls in the range [0-10]
+    int priority = static_cast<int>(order.getItem()) + static_cast<int>(order.getMemebership());
+    return priority;
+}
@@ -0,0 +1,113 @@
+#include "blockingcqueue.h"
+#include <thread>
+const int MINSPIN = 16;    // spin limits for consumers that find the queue empty
+const int MAXSPIN = 4096;
+
+BlockingCQueue::BlockingCQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure)
+    : m_queue(priFn, heapType, structure), m_waiters(0), m_size(0), m_spinLimit(256) {
+}
+ADMISSION BlockingCQueue::insertOrder(const Order& order) {
+    ADMISSION status;
+    {
+        lock_guard<mutex> guard(m_lock);
+        status = m_queue.insertOrder(order);
+        m_size.store(m_queue.numOrders(), memory_order_release);
+        if (status != ADMITTED || m_waiters == 0) {
+            return status;
+        }
+    }
+    wake(1);
+    return status;
+}
+void BlockingCQueue::insertOrders(const vector<Order>& orders) {
+    int added;
+    {
+        lock_guard<mutex> guard(m_lock);
+        int before = m_queue.numOrders();
+        for (unsigned int i = 0; i < orders.size(); i++) {
+            m_queue.insertOrder(orders[i]);
+        }
+        added = m_queue.numOrders() - before;
+        m_size.store(m_queue.numOrders(), memory_order_release);
+        if (m_waiters < added) {
+            added = m_waiters;
+        }
+    }
+    wake(added);
+}
+void BlockingCQueue::mergeWithQueue(CQueue& rhs) {
+    int added;
+    {
+        lock_guard<mutex> guard(m_lock);
+        int before = m_queue.numOrders();
+        m_queue.mergeWithQueue(rhs);
+        added = m_queue.numOrders() - before;
+        m_size.store(m_queue.numOrders(), memory_order_release);
+        if (m_waiters < added) {
+            added = m_waiters;
+        }
+    }
+    wake(added);
+}
+Order BlockingCQueue::getNextOrder() {
+    lock_guard<mutex> guard(m_lock);
+    Order order = m_queue.getNextOrder();
+    m_size.store(m_queue.numOrders(), memory_order_release);
+    return order;
+}
+Order BlockingCQueue::waitNextOrder() {
+    spinForOrder();
+    unique_lock<mutex> guard(m_lock);
+    m_waiters += 1;
+    m_available.wait(guard, [this] {return m_queue.numOrders() > 0;});
+    m_waiters -= 1;
+    Order order = m_queue.getNextOrder();
+    m_size.store(m_queue.numOrders(), memory_order_release);
+    return order;
+}
+bool BlockingCQueue::tryGetNextOrder(Order& order, chrono::microseconds timeout) {
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + timeout;
+    if (timeout.count() > 0) {
+        spinForOrder();
+    }
+    unique_lock<mutex> guard(m_lock);
+    m_waiters += 1;
+    bool ready = m_available.wait_until(guard, deadline, [this] {return m_queue.numOrders() > 0;});
+    m_waiters -= 1;
+    if (!ready) {
+        return false;
+    }
+    order = m_queue.getNextOrder();
+    m_size.store(m_queue.numOrders(), memory_order_release);
+    return true;
+}
+int BlockingCQueue::numOrders() const {
+    lock_guard<mutex> guard(m_lock);
+    return m_queue.numOrders();
+}
+// Spins before sleeping since a wake up through the kernel costs several
+// microseconds. The limit doubles when spinning found an order and halves
+// when it did not, and on a single core spinning only delays the producer.
+bool BlockingCQueue::spinForOrder() {
+    static const bool multicore = thread::hardware_concurrency() > 1;
+    if (!multicore) {
+        return m_size.load(memory_order_acquire) > 0;
+    }
+    int limit = m_spinLimit.load(memory_order_relaxed);
+    for (int i = 0; i < limit; i++) {
+        if (m_size.load(memory_order_acquire) > 0) {
+            m_spinLimit.store(limit * 2 < MAXSPIN ? limit * 2 : MAXSPIN, memory_order_relaxed);
+            return true;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    m_spinLimit.store(limit / 2 > MINSPIN ? limit / 2 : MINSPIN, memory_order_relaxed);
+    return false;
+}
+void BlockingCQueue::wake(int orders) {
+    for (int i = 0; i < orders; i++) {
+        m_available.notify_one();
+    }
+}
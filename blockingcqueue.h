@@ -0,0 +1,39 @@
+#ifndef BLOCKINGCQUEUE_H
+#define BLOCKINGCQUEUE_H
+#include "cqueue.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+class BlockingCQueue{
+    // A CQueue shared between producer and consumer threads. Consumers that
+    // find it empty spin briefly and then sleep on a condition variable
+    // (a futex on Linux), every accepted order wakes at most one of them.
+public:
+    BlockingCQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure);
+    BlockingCQueue(const BlockingCQueue&) = delete;
+    BlockingCQueue& operator=(const BlockingCQueue&) = delete;
+    ADMISSION insertOrder(const Order& order);
+    // inserts under one lock and wakes up to one waiter per accepted order
+    void insertOrders(const vector<Order>& orders);
+    // takes all orders of rhs and wakes up to one waiter per order taken
+    void mergeWithQueue(CQueue& rhs);
+    Order getNextOrder();   // throws out_of_range when empty, like CQueue
+    Order waitNextOrder();  // blocks until an order is available
+    // waits at most timeout, returns false and leaves order alone if none came
+    bool tryGetNextOrder(Order& order, chrono::microseconds timeout);
+    int numOrders() const;
+
+private:
+    CQueue m_queue;
+    mutable mutex m_lock;           // guards m_queue and m_waiters
+    condition_variable m_available; // signalled once per order for sleeping consumers
+    int m_waiters;                  // consumers sleeping on m_available
+    atomic<int> m_size;             // copy of the size that spinning consumers can poll
+    atomic<int> m_spinLimit;        // adapts to how often spinning pays off
+
+    bool spinForOrder();            // true if an order showed up while spinning
+    void wake(int orders);          // call after releasing m_lock
+};
+#endif
@@ -0,0 +1,208 @@
+#include "boundedcqueue.h"
+
+BoundedCQueue::BoundedCQueue(prifn_t priFn, HEAPTYPE heapType, int capacity) {
+    if (capacity < 1) {
+        throw invalid_argument("the capacity must be at least one order");
+    }
+    m_priorFunc = priFn;
+    m_heapType = heapType;
+    m_capacity = capacity;
+    m_heap.reserve(capacity);
+}
+ADMISSION BoundedCQueue::insertOrder(const Order& order, Order& evicted, bool& hasEvicted) {
+    hasEvicted = false;
+    if (order.getCustomerID() < MINCUSTID || order.getCustomerID() > MAXCUSTID ||
+        order.getOrderID() < MINORDERID || order.getOrderID() > MAXORDERID) {
+        return INVALIDID;
+    }
+    Entry entry;
+    entry.m_key = helpKey(order);
+    entry.m_order = order;
+    bool full = (int)m_heap.size() >= m_capacity;
+    if (full) {
+        int worst = helpWorstIndex();
+        hasEvicted = true;
+        if (entry.m_key >= m_heap[worst].m_key) { // not better than anything queued
+            evicted = order;
+            return ADMITTED;
+        }
+        evicted = helpRemove(worst);
+    }
+    m_heap.push_back(entry);
+    helpPushUp((int)m_heap.size() - 1);
+    return ADMITTED;
+}
+Order BoundedCQueue::getNextOrder() {
+    if (m_heap.empty()) {
+        throw out_of_range("the queue is empty");
+    }
+    return helpRemove(0);
+}
+Order BoundedCQueue::getWorstOrder() const {
+    if (m_heap.empty()) {
+        throw out_of_range("the queue is empty");
+    }
+    return m_heap[helpWorstIndex()].m_order;
+}
+Order BoundedCQueue::evictWorstOrder() {
+    if (m_heap.empty()) {
+        throw out_of_range("the queue is empty");
+    }
+    return helpRemove(helpWorstIndex());
+}
+int BoundedCQueue::numOrders() const {
+    return (int)m_heap.size();
+}
+int BoundedCQueue::capacity() const {
+    return m_capacity;
+}
+void BoundedCQueue::clear() {
+    m_heap.clear();
+}
+prifn_t BoundedCQueue::getPriorityFn() const {
+    return m_priorFunc;
+}
+HEAPTYPE BoundedCQueue::getHeapType() const {
+    return m_heapType;
+}
+// recomputes the keys and heapifies bottom up (Floyd), linear time
+void BoundedCQueue::setPriorityFn(prifn_t priFn, HEAPTYPE heapType) {
+    m_priorFunc = priFn;
+    m_heapType = heapType;
+    for (unsigned int i = 0; i < m_heap.size(); i++) {
+        m_heap[i].m_key = helpKey(m_heap[i].m_order);
+    }
+    for (int i = (int)m_heap.size() / 2 - 1; i >= 0; i--) {
+        helpPushDown(i);
+    }
+}
+int BoundedCQueue::helpKey(const Order& order) const {
+    int priority = m_priorFunc(order);
+    return m_heapType == MINHEAP ? priority : -priority;
+}
+// the largest key sits on the first max level, right below the root
+int BoundedCQueue::helpWorstIndex() const {
+    if (m_heap.size() == 1) {
+        return 0;
+    }
+    if (m_heap.size() == 2 || m_heap[1].m_key >= m_heap[2].m_key) {
+        return 1;
+    }
+    return 2;
+}
+// replaces the entry with the last one and restores the heap below it
+Order BoundedCQueue::helpRemove(int index) {
+    Order order = m_heap[index].m_order;
+    m_heap[index] = m_heap.back();
+    m_heap.pop_back();
+    if (index < (int)m_heap.size()) {
+        helpPushDown(index);
+        helpPushUp(index); // the moved entry can also belong further up
+    }
+    return order;
+}
+bool BoundedCQueue::helpMinLevel(int index) {
+    int level = 0;
+    for (unsigned int i = index + 1; i > 1; i /= 2) {
+        level++;
+    }
+    return level % 2 == 0;
+}
+void BoundedCQueue::helpPushUp(int index) {
+    if (index == 0) {
+        return;
+    }
+    int parent = (index - 1) / 2;
+    if (helpMinLevel(index)) {
+        if (m_heap[index].m_key > m_heap[parent].m_key) {
+            swap(m_heap[index], m_heap[parent]);
+            helpPushUpMax(parent);
+        } else {
+            helpPushUpMin(index);
+        }
+    } else {
+        if (m_heap[index].m_key < m_heap[parent].m_key) {
+            swap(m_heap[index], m_heap[parent]);
+            helpPushUpMin(parent);
+        } else {
+            helpPushUpMax(index);
+        }
+    }
+}
+// moves up through the grandparents, which are on the same kind of level
+void BoundedCQueue::helpPushUpMin(int index) {
+    while (index > 2) {
+        int grandparent = ((index - 1) / 2 - 1) / 2;
+        if (m_heap[index].m_key >= m_heap[grandparent].m_key) {
+            break;
+        }
+        swap(m_heap[index], m_heap[grandparent]);
+        index = grandparent;
+    }
+}
+void BoundedCQueue::helpPushUpMax(int index) {
+    while (index > 2) {
+        int grandparent = ((index - 1) / 2 - 1) / 2;
+        if (m_heap[index].m_key <= m_heap[grandparent].m_key) {
+            break;
+        }
+        swap(m_heap[index], m_heap[grandparent]);
+        index = grandparent;
+    }
+}
+void BoundedCQueue::helpPushDown(int index) {
+    if (helpMinLevel(index)) {
+        helpPushDownMin(index);
+    } else {
+        helpPushDownMax(index);
+    }
+}
+// index of the smallest (or largest) of the children and grandchildren, -1 if none
+int BoundedCQueue::helpExtreme(int index, bool smallest) const {
+    int size = (int)m_heap.size();
+    int best = -1;
+    int candidates[] = {2 * index + 1, 2 * index + 2,
+                        4 * index + 3, 4 * index + 4, 4 * index + 5, 4 * index + 6};
+    for (int i = 0; i < 6 && candidates[i] < size; i++) {
+        int c = candidates[i];
+        if (best == -1 || (smallest ? m_heap[c].m_key < m_heap[best].m_key
+                                    : m_heap[c].m_key > m_heap[best].m_key)) {
+            best = c;
+        }
+    }
+    return best;
+}
+void BoundedCQueue::helpPushDownMin(int index) {
+    while (true) {
+        int m = helpExtreme(index, true);
+        if (m == -1 || m_heap[m].m_key >= m_heap[index].m_key) {
+            return;
+        }
+        swap(m_heap[m], m_heap[index]);
+        if (m <= 2 * index + 2) { // a child, nothing below it can be smaller
+            return;
+        }
+        int parent = (m - 1) / 2;
+        if (m_heap[m].m_key > m_heap[parent].m_key) {
+            swap(m_heap[m], m_heap[parent]);
+        }
+        index = m;
+    }
+}
+void BoundedCQueue::helpPushDownMax(int index) {
+    while (true) {
+        int m = helpExtreme(index, false);
+        if (m == -1 || m_heap[m].m_key <= m_heap[index].m_key) {
+            return;
+        }
+        swap(m_heap[m], m_heap[index]);
+        if (m <= 2 * index + 2) {
+            return;
+        }
+        int parent = (m - 1) / 2;
+        if (m_heap[m].m_key < m_heap[parent].m_key) {
+            swap(m_heap[m], m_heap[parent]);
+        }
+        index = m;
+    }
+}
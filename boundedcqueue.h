@@ -0,0 +1,51 @@
+#ifndef BOUNDEDCQUEUE_H
+#define BOUNDEDCQUEUE_H
+#include "cqueue.h"
+
+class BoundedCQueue{
+    // A priority queue capped at a fixed number of orders. It is kept in a
+    // min-max heap so both the best and the worst order are at the top: the
+    // best at the root, the worst at one of its children. Keys are stored
+    // negated for a MAXHEAP, so the best order is always the smallest key.
+public:
+    BoundedCQueue(prifn_t priFn, HEAPTYPE heapType, int capacity);
+    // Inserts an order. When the queue is full the lowest priority order is
+    // evicted, which may be the new order itself, and hasEvicted is set with
+    // it in evicted. Orders with invalid IDs are refused with INVALIDID like
+    // in CQueue, nothing is evicted then.
+    ADMISSION insertOrder(const Order& order, Order& evicted, bool& hasEvicted);
+    Order getNextOrder();        // removes the highest priority order
+    Order getWorstOrder() const; // the lowest priority order, left in the queue
+    Order evictWorstOrder();     // removes the lowest priority order
+    int numOrders() const;
+    int capacity() const;
+    void clear();
+    prifn_t getPriorityFn() const;
+    HEAPTYPE getHeapType() const;
+    // Set a new priority function, the heap is rebuilt in linear time
+    void setPriorityFn(prifn_t priFn, HEAPTYPE heapType);
+
+private:
+    class Entry{
+    public:
+        int m_key;      // priority, negated for a MAXHEAP
+        Order m_order;
+    };
+    vector<Entry> m_heap;   // min-max heap, even levels are min levels
+    int m_capacity;
+    prifn_t m_priorFunc;
+    HEAPTYPE m_heapType;
+
+    int helpKey(const Order& order) const;
+    int helpWorstIndex() const;
+    Order helpRemove(int index);
+    void helpPushUp(int index);
+    void helpPushUpMin(int index);
+    void helpPushUpMax(int index);
+    void helpPushDown(int index);
+    void helpPushDownMin(int index);
+    void helpPushDownMax(int index);
+    int helpExtreme(int index, bool smallest) const; // best child or grandchild
+    static bool helpMinLevel(int index);
+};
+#endif
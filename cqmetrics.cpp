@@ -0,0 +1,246 @@
+#include "cqmetrics.h"
+#include <fstream>
+mutex LatencyRecorder::m_lock;
+vector<shared_ptr<LatencyRecorder::ThreadHistograms> > LatencyRecorder::m_threads;
+atomic<bool> TraceRecorder::m_enabled(false);
+atomic<int> TraceRecorder::m_capacity(65536);
+mutex TraceRecorder::m_lock;
+vector<shared_ptr<TraceRecorder::Ring> > TraceRecorder::m_rings;
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+void LatencyHistogram::reset() {
+    for (int i = 0; i < BUCKETS; i++) {
+        m_counts[i].store(0, memory_order_relaxed);
+    }
+    m_count.store(0, memory_order_relaxed);
+    m_max.store(0, memory_order_relaxed);
+}
+// single writer, so plain load and store are enough and no locked instruction is needed
+void LatencyHistogram::record(unsigned long long value) {
+    atomic<unsigned long long>& bucket = m_counts[bucketOf(value)];
+    bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    m_count.store(m_count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    if (value > m_max.load(memory_order_relaxed)) {
+        m_max.store(value, memory_order_relaxed);
+    }
+}
+void LatencyHistogram::add(const LatencyHistogram& rhs) {
+    for (int i = 0; i < BUCKETS; i++) {
+        m_counts[i].store(m_counts[i].load(memory_order_relaxed)
+                          + rhs.m_counts[i].load(memory_order_relaxed), memory_order_relaxed);
+    }
+    m_count.store(m_count.load(memory_order_relaxed)
+                  + rhs.m_count.load(memory_order_relaxed), memory_order_relaxed);
+    if (rhs.m_max.load(memory_order_relaxed) > m_max.load(memory_order_relaxed)) {
+        m_max.store(rhs.m_max.load(memory_order_relaxed), memory_order_relaxed);
+    }
+}
+unsigned long long LatencyHistogram::count() const {
+    return m_count.load(memory_order_relaxed);
+}
+unsigned long long LatencyHistogram::max() const {
+    return m_max.load(memory_order_relaxed);
+}
+unsigned long long LatencyHistogram::percentile(double p) const {
+    unsigned long long total = count();
+    if (total == 0) {
+        return 0;
+    }
+    // rank of the value we are looking for, at least the first one
+    unsigned long long rank = (unsigned long long)(p * total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    unsigned long long seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += m_counts[i].load(memory_order_relaxed);
+        if (seen >= rank) {
+            unsigned long long top = bucketTop(i);
+            return top < max() ? top : max();
+        }
+    }
+    return max();
+}
+LatencySummary LatencyHistogram::summary() const {
+    LatencySummary result;
+    result.m_count = count();
+    result.m_p50 = percentile(0.50);
+    result.m_p99 = percentile(0.99);
+    result.m_p999 = percentile(0.999);
+    result.m_max = max();
+    return result;
+}
+// values below SUBBUCKETS get a bucket each, above that the top SUBBITS bits
+// after the leading one select the sub-bucket of the power of two
+int LatencyHistogram::bucketOf(unsigned long long value) {
+    if (value < (unsigned long long)SUBBUCKETS) {
+        return (int)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int sub = (int)((value >> (msb - SUBBITS)) & (SUBBUCKETS - 1));
+    return (msb - SUBBITS + 1) * SUBBUCKETS + sub;
+}
+unsigned long long LatencyHistogram::bucketTop(int bucket) {
+    if (bucket < SUBBUCKETS) {
+        return (unsigned long long)bucket;
+    }
+    int shift = bucket / SUBBUCKETS - 1;
+    unsigned long long sub = (unsigned long long)(bucket % SUBBUCKETS);
+    unsigned long long low = ((unsigned long long)SUBBUCKETS + sub) << shift;
+    return low + ((1ULL << shift) - 1);
+}
+
+// the first call on a thread registers its histograms
+LatencyRecorder::ThreadHistograms& LatencyRecorder::local() {
+    thread_local shared_ptr<ThreadHistograms> histograms;
+    if (!histograms) {
+        histograms = make_shared<ThreadHistograms>();
+        lock_guard<mutex> guard(m_lock);
+        m_threads.push_back(histograms);
+    }
+    return *histograms;
+}
+void LatencyRecorder::record(STRUCTURE structure, OPERATION operation, unsigned long long nanos) {
+    local().m_histograms[structure][operation].record(nanos);
+}
+LatencySummary LatencyRecorder::summary(STRUCTURE structure, OPERATION operation) {
+    LatencyHistogram merged;
+    lock_guard<mutex> guard(m_lock);
+    for (unsigned int i = 0; i < m_threads.size(); i++) {
+        merged.add(m_threads[i]->m_histograms[structure][operation]);
+    }
+    return merged.summary();
+}
+void LatencyRecorder::report(ostream& sout) {
+    const char *structures[] = {"skew", "leftist"};
+    const char *operations[] = {"insertOrder", "getNextOrder", "mergeWithQueue", "rebuild", "bulkLoad"};
+    for (int s = 0; s < NUMSTRUCTURES; s++) {
+        for (int o = 0; o < NUMOPERATIONS; o++) {
+            LatencySummary result = summary(static_cast<STRUCTURE>(s), static_cast<OPERATION>(o));
+            if (result.m_count > 0) {
+                sout << structures[s] << " " << operations[o]
+                     << ": count " << result.m_count
+                     << ", p50 " << result.m_p50 << "ns"
+                     << ", p99 " << result.m_p99 << "ns"
+                     << ", p99.9 " << result.m_p999 << "ns"
+                     << ", max " << result.m_max << "ns" << endl;
+            }
+        }
+    }
+}
+// resetting while other threads record may lose a few of their samples
+void LatencyRecorder::reset() {
+    lock_guard<mutex> guard(m_lock);
+    for (unsigned int i = 0; i < m_threads.size(); i++) {
+        for (int s = 0; s < NUMSTRUCTURES; s++) {
+            for (int o = 0; o < NUMOPERATIONS; o++) {
+                m_threads[i]->m_histograms[s][o].reset();
+            }
+        }
+    }
+}
+
+void TraceRecorder::enable(bool on) {
+    now(); // starts the clock before the first event
+    m_enabled.store(on, memory_order_relaxed);
+}
+void TraceRecorder::setCapacity(int events) {
+    if (events > 0) {
+        m_capacity.store(events, memory_order_relaxed);
+    }
+}
+unsigned long long TraceRecorder::now() {
+    static const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+// the first event on a thread registers its ring
+TraceRecorder::Ring& TraceRecorder::local() {
+    thread_local shared_ptr<Ring> ring;
+    if (!ring) {
+        ring = make_shared<Ring>(m_capacity.load(memory_order_relaxed));
+        lock_guard<mutex> guard(m_lock);
+        ring->m_thread = (int)m_rings.size() + 1;
+        m_rings.push_back(ring);
+    }
+    return *ring;
+}
+void TraceRecorder::record(OPERATION operation, int orderID, int size,
+                           unsigned long long begin, unsigned long long end) {
+    Ring& ring = local();
+    unsigned long long head = ring.m_head.load(memory_order_relaxed);
+    TraceEvent& event = ring.m_events[head % ring.m_events.size()];
+    event.m_operation = operation;
+    event.m_orderID = orderID;
+    event.m_size = size;
+    event.m_begin = begin;
+    event.m_end = end;
+    ring.m_head.store(head + 1, memory_order_release);
+}
+void TraceRecorder::clear() {
+    lock_guard<mutex> guard(m_lock);
+    for (unsigned int i = 0; i < m_rings.size(); i++) {
+        m_rings[i]->m_head.store(0, memory_order_relaxed);
+    }
+}
+string escapeQuoted(const string& text, bool json) {
+    string escaped;
+    escaped.reserve(text.size());
+    for (unsigned int i = 0; i < text.size(); i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += (char)c;
+        }
+        else if (c == '\n') {
+            escaped += "\\n";
+        }
+        else if (c < 0x20 && json) {
+            const char *digits = "0123456789abcdef";
+            escaped += "\\u00";
+            escaped += digits[c >> 4];
+            escaped += digits[c & 15];
+        }
+        else {
+            escaped += (char)c;
+        }
+    }
+    return escaped;
+}
+void TraceRecorder::dumpChromeTrace(ostream& sout) {
+    const char *names[] = {"insertOrder", "getNextOrder", "mergeWithQueue", "rebuild", "bulkLoad"};
+    lock_guard<mutex> guard(m_lock);
+    sout << "{\"traceEvents\":[";
+    bool first = true;
+    for (unsigned int r = 0; r < m_rings.size(); r++) {
+        Ring& ring = *m_rings[r];
+        unsigned long long head = ring.m_head.load(memory_order_acquire);
+        unsigned long long capacity = ring.m_events.size();
+        unsigned long long oldest = head > capacity ? head - capacity : 0;
+        for (unsigned long long i = oldest; i < head; i++) {
+            const TraceEvent& event = ring.m_events[i % capacity];
+            // timestamps are in microseconds, keep the nanoseconds as decimals
+            sout << (first ? "\n" : ",\n")
+                 << "{\"name\":\"" << escapeQuoted(names[event.m_operation], true) << "\",\"cat\":\"cqueue\",\"ph\":\"X\""
+                 << ",\"ts\":" << event.m_begin / 1000 << "." << event.m_begin % 1000 / 100
+                 << event.m_begin % 100 / 10 << event.m_begin % 10
+                 << ",\"dur\":" << (event.m_end - event.m_begin) / 1000 << "."
+                 << (event.m_end - event.m_begin) % 1000 / 100
+                 << (event.m_end - event.m_begin) % 100 / 10 << (event.m_end - event.m_begin) % 10
+                 << ",\"pid\":1,\"tid\":" << ring.m_thread
+                 << ",\"args\":{\"size\":" << event.m_size << ",\"orderID\":" << event.m_orderID << "}}";
+            first = false;
+        }
+    }
+    sout << "\n],\"displayTimeUnit\":\"ns\"}" << endl;
+}
+bool TraceRecorder::dumpChromeTrace(const string& fileName) {
+    ofstream out(fileName.c_str());
+    if (!out) {
+        return false;
+    }
+    dumpChromeTrace(out);
+    out.close();
+    return !out.fail();
+}
@@ -0,0 +1,178 @@
+#ifndef CQMETRICS_H
+#define CQMETRICS_H
+#include "cqueue.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+// Compile with -DCQUEUE_LATENCY to time the queue operations. Every thread
+// records into its own histograms, so recording never takes a lock.
+#ifdef CQUEUE_LATENCY
+#define CQUEUE_LATENCY_SCOPE(structure, operation) LatencyTimer cqLatencyTimer(structure, operation)
+#else
+#define CQUEUE_LATENCY_SCOPE(structure, operation)
+#endif
+// Compile with -DCQUEUE_TRACE to build in the trace recorder, it still has
+// to be switched on with TraceRecorder::enable(true).
+#ifdef CQUEUE_TRACE
+#define CQUEUE_TRACE_SCOPE(operation, size, orderID) TraceScope cqTraceScope(operation, size, orderID)
+#define CQUEUE_TRACE_ORDER(orderID) cqTraceScope.setOrderID(orderID)
+#else
+#define CQUEUE_TRACE_SCOPE(operation, size, orderID)
+#define CQUEUE_TRACE_ORDER(orderID)
+#endif
+
+enum OPERATION {INSERTORDER, NEXTORDER, MERGEQUEUE, REBUILDHEAP, BULKLOAD};
+const int NUMOPERATIONS = 5;
+const int NUMSTRUCTURES = 2;
+// Escapes text for a double-quoted JSON string or Prometheus label value:
+// backslash, quote and newline always, other control characters as \u00XX
+// for JSON. Prometheus takes them as they are.
+string escapeQuoted(const string& text, bool json);
+
+class LatencySummary{
+    // percentiles of one histogram, all values in nanoseconds
+public:
+    LatencySummary() {
+        m_count = 0; m_p50 = 0; m_p99 = 0; m_p999 = 0; m_max = 0;
+    }
+    unsigned long long m_count;
+    unsigned long long m_p50;
+    unsigned long long m_p99;
+    unsigned long long m_p999;
+    unsigned long long m_max;
+};
+
+class LatencyHistogram{
+    // HDR style histogram: every power of two is split into 8 linear
+    // sub-buckets, so a reported value is within 12.5% of the recorded one.
+    // Only the owning thread records, readers may run on any thread.
+public:
+    static const int SUBBITS = 3;
+    static const int SUBBUCKETS = 1 << SUBBITS;
+    static const int BUCKETS = (64 - SUBBITS + 1) * SUBBUCKETS;
+    LatencyHistogram();
+    void record(unsigned long long value);
+    void reset();
+    void add(const LatencyHistogram& rhs); // sums rhs into this histogram
+    unsigned long long count() const;
+    unsigned long long max() const;
+    // smallest recorded value (bucket upper bound) with fraction p of the values at or below it
+    unsigned long long percentile(double p) const;
+    LatencySummary summary() const;
+
+    static int bucketOf(unsigned long long value);
+    static unsigned long long bucketTop(int bucket); // largest value of a bucket
+
+private:
+    atomic<unsigned long long> m_counts[BUCKETS];
+    atomic<unsigned long long> m_count;
+    atomic<unsigned long long> m_max;
+};
+
+class LatencyRecorder{
+    // per thread histograms for every structure and operation, threads
+    // register once and their data stays around after they exit
+public:
+    static void record(STRUCTURE structure, OPERATION operation, unsigned long long nanos);
+    // merges the histograms of all threads
+    static LatencySummary summary(STRUCTURE structure, OPERATION operation);
+    static void report(ostream& sout); // one line per structure and operation
+    static void reset();
+
+private:
+    class ThreadHistograms{
+    public:
+        LatencyHistogram m_histograms[NUMSTRUCTURES][NUMOPERATIONS];
+    };
+    static ThreadHistograms& local();
+    static mutex m_lock;                                // guards m_threads
+    static vector<shared_ptr<ThreadHistograms> > m_threads;
+};
+
+class LatencyTimer{
+    // times a scope with steady_clock and records it when the scope ends
+public:
+    LatencyTimer(STRUCTURE structure, OPERATION operation) {
+        m_structure = structure;
+        m_operation = operation;
+        m_start = chrono::steady_clock::now();
+    }
+    ~LatencyTimer() {
+        chrono::steady_clock::duration elapsed = chrono::steady_clock::now() - m_start;
+        LatencyRecorder::record(m_structure, m_operation,
+                                chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+    }
+
+private:
+    STRUCTURE m_structure;
+    OPERATION m_operation;
+    chrono::steady_clock::time_point m_start;
+};
+
+class TraceEvent{
+    // one completed queue operation
+public:
+    OPERATION m_operation;
+    int m_orderID;              // 0 when the operation has no single order
+    int m_size;                 // queue size when the operation finished
+    unsigned long long m_begin; // nanoseconds since the recorder started
+    unsigned long long m_end;
+};
+
+class TraceRecorder{
+    // Every thread writes into its own ring buffer and publishes the slot
+    // with a release store, so recording needs no lock or atomic RMW. When
+    // a ring is full the oldest events are overwritten. Dump while tracing
+    // is disabled, or the threads being dumped may overwrite events mid-copy.
+public:
+    static void enable(bool on);
+    static bool enabled() {return m_enabled.load(memory_order_relaxed);}
+    static void setCapacity(int events); // per thread ring size, for rings created later
+    static unsigned long long now();     // nanoseconds since the recorder started
+    static void record(OPERATION operation, int orderID, int size,
+                       unsigned long long begin, unsigned long long end);
+    static void clear();
+    // writes the events of all threads in the Chrome trace-event JSON format
+    static void dumpChromeTrace(ostream& sout);
+    static bool dumpChromeTrace(const string& fileName);
+
+private:
+    class Ring{
+    public:
+        explicit Ring(int capacity) : m_events(capacity), m_head(0) {}
+        vector<TraceEvent> m_events;
+        atomic<unsigned long long> m_head; // number of events ever written
+        int m_thread;                      // tid shown in the trace viewer
+    };
+    static Ring& local();
+    static atomic<bool> m_enabled;
+    static atomic<int> m_capacity;
+    static mutex m_lock;                 // guards m_rings
+    static vector<shared_ptr<Ring> > m_rings;
+};
+
+class TraceScope{
+    // records one event for the enclosing scope if tracing is on when it starts
+public:
+    TraceScope(OPERATION operation, const int& size, int orderID) : m_size(size) {
+        m_active = TraceRecorder::enabled();
+        m_operation = operation;
+        m_orderID = orderID;
+        m_begin = m_active ? TraceRecorder::now() : 0;
+    }
+    ~TraceScope() {
+        if (m_active) {
+            TraceRecorder::record(m_operation, m_orderID, m_size, m_begin, TraceRecorder::now());
+        }
+    }
+    void setOrderID(int orderID) {m_orderID = orderID;}
+
+private:
+    bool m_active;
+    OPERATION m_operation;
+    const int& m_size;
+    int m_orderID;
+    unsigned long long m_begin;
+};
+#endif
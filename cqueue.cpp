@@ -1,97 +1,649 @@
 #include "cqueue.h"
+#include "cqmetrics.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <cstdio>
+#include <new>
+atomic<long long> CQueue::m_epochClock(0);
 // default constructor setting all the objects
 CQueue::CQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure){
     m_size = 0;
     m_heap = nullptr;
+    m_stale = nullptr;
     m_priorFunc = priFn;
     m_heapType = heapType;
     m_structure = structure;
+    m_agingWeight = 0;
+    m_agingCurve = nullptr;
+    m_rekeyInterval = 0;
+    m_rekeyEpoch = 0;
+    m_sequence = 0;
+    m_itemIndex = false;
+    for (int i = 0; i < NUMITEMS; i++) {
+        m_items[i] = nullptr;
+    }
+    m_maxOutstanding = 0;
+    m_tokenRate = 0;
+    m_tokenBurst = 0;
+    m_compactThreshold = 0;
+    m_lazyMerge = false;
+}
+CQueue::CQueue(const PriorityTable& table, HEAPTYPE heapType, STRUCTURE structure)
+    : CQueue(nullptr, heapType, structure) {
+    m_priorTable = table;
 }
-// destructor calls clear and deallocates all memory
+// destructor deallocates all memory, the pool also holds the taken nodes
+// only the item index links
 CQueue::~CQueue(){
-     if(m_heap != nullptr) {
-         clear();
-     }
+     m_pool.clear();
+     m_store.clear();
      m_heap = nullptr;
+     m_stale = nullptr;
+     m_pending.clear();
      m_size = 0;
 }
-//clear calls help clear
+// clear frees the node blocks and the orders at once, no need to walk the
+// heap or the index
 void CQueue::clear() {
-    helpClear(m_heap);
+    helpForgetOrders();
+    helpForgetItemIndex();
+    m_pool.clear();
+    m_store.clear(); // the nodes are gone, so are the handles
+    m_heap = nullptr;
+    m_stale = nullptr;
+    m_pending.clear();
+    m_size = 0;
 }
-// copy constructor copies another queue
+// copy constructor copies another queue, into one block of nodes
 CQueue::CQueue(const CQueue& rhs){ // copying for Rhs
-        m_heap = helpCopy(rhs.m_heap);
+        m_store.copy(rhs.m_store); // first, helpCopy translates the handles
+        m_pool.reset(rhs.m_pool.live());
+        int taken = 0;
+        m_heap = helpCopy(rhs.m_heap, taken);
+        m_stale = helpCopy(rhs.m_stale, taken);
+        for (unsigned int i = 0; i < rhs.m_pending.size(); i++) {
+            m_pending.push_back(helpCopy(rhs.m_pending[i], taken));
+        }
+        m_lazyMerge = rhs.m_lazyMerge;
         m_size = rhs.m_size;
         m_priorFunc = rhs.m_priorFunc;
+        m_priorTable = rhs.m_priorTable;
         m_heapType = rhs.m_heapType;
         m_structure = rhs.m_structure;
+        m_agingWeight = rhs.m_agingWeight;
+        m_agingCurve = rhs.m_agingCurve;
+        m_rekeyInterval = rhs.m_rekeyInterval;
+        m_rekeyEpoch = rhs.m_rekeyEpoch;
+        m_sequence = rhs.m_sequence;
+        m_itemIndex = false; // the copy builds its own when needed
+        for (int i = 0; i < NUMITEMS; i++) {
+            m_items[i] = nullptr;
+        }
+        m_outstanding = rhs.m_outstanding;
+        m_tokens = rhs.m_tokens;
+        m_refillEpoch = rhs.m_refillEpoch;
+        m_maxOutstanding = rhs.m_maxOutstanding;
+        m_tokenRate = rhs.m_tokenRate;
+        m_tokenBurst = rhs.m_tokenBurst;
+        m_compactThreshold = rhs.m_compactThreshold;
+        if (taken > 0) { // the configuration is needed to meld
+            helpDropTaken();
+        }
 }
 CQueue& CQueue::operator=(const CQueue& rhs) { // calling clear and basically copying and pasting the copy constructor
     if (&rhs != this){
-        clear();
-        m_heap = helpCopy(rhs.m_heap);
+        // like clear, but the node blocks are kept and the copy is laid out in them
+        helpForgetOrders();
+        helpForgetItemIndex();
+        m_pool.reset(rhs.m_pool.live());
+        m_store.copy(rhs.m_store);
+        int taken = 0;
+        m_heap = helpCopy(rhs.m_heap, taken);
+        m_stale = helpCopy(rhs.m_stale, taken);
+        m_pending.clear();
+        for (unsigned int i = 0; i < rhs.m_pending.size(); i++) {
+            m_pending.push_back(helpCopy(rhs.m_pending[i], taken));
+        }
+        m_lazyMerge = rhs.m_lazyMerge;
         m_size = rhs.m_size;
         m_priorFunc = rhs.m_priorFunc;
+        m_priorTable = rhs.m_priorTable;
         m_heapType = rhs.m_heapType;
         m_structure = rhs.m_structure;
+        m_agingWeight = rhs.m_agingWeight;
+        m_agingCurve = rhs.m_agingCurve;
+        m_rekeyInterval = rhs.m_rekeyInterval;
+        m_rekeyEpoch = rhs.m_rekeyEpoch;
+        m_sequence = rhs.m_sequence;
+        m_outstanding = rhs.m_outstanding;
+        m_tokens = rhs.m_tokens;
+        m_refillEpoch = rhs.m_refillEpoch;
+        m_maxOutstanding = rhs.m_maxOutstanding;
+        m_tokenRate = rhs.m_tokenRate;
+        m_tokenBurst = rhs.m_tokenBurst;
+        m_compactThreshold = rhs.m_compactThreshold;
+        if (taken > 0) {
+            helpDropTaken();
+        }
+    }
+    return *this;
+}
+CQueue::CQueue(CQueue&& rhs) : CQueue(rhs.m_priorFunc, rhs.m_heapType, rhs.m_structure) {
+    helpTake(rhs);
+}
+CQueue& CQueue::operator=(CQueue&& rhs) {
+    if (&rhs != this) {
+        clear();
+        helpTake(rhs);
     }
     return *this;
 }
 // merge two queues together with rhs
 void CQueue::mergeWithQueue(CQueue& rhs) {
-    // checks everything is the same between the two structure
-    if (rhs.m_heap != nullptr && m_priorFunc == rhs.m_priorFunc && m_structure == rhs.m_structure) {
+    CQUEUE_LATENCY_SCOPE(m_structure, MERGEQUEUE);
+    CQUEUE_TRACE_SCOPE(MERGEQUEUE, m_size, 0);
+    if (rhs.m_size != 0) { // a heap of taken nodes alone has nothing to merge
         if(m_heap != rhs.m_heap) { // checks against self merging
-            m_heap = helpMerge(m_heap, rhs.m_heap); // calls help merge
+            rhs.helpFinishRekey(); // its stale keys are for an epoch we don't know
+            CQueue config = rhs.helpWorker(); // rhs gets its configuration back once it is empty
+            if (!helpMergeable(rhs)) { // the smaller queue is converted
+                if (rhs.m_size <= m_size) {
+                    rhs.helpConvert(*this);
+                }
+                else {
+                    helpConvert(rhs);
+                }
+            }
+            bool rebase = (m_agingCurve != nullptr || m_agingWeight != 0) && m_rekeyEpoch != rhs.m_rekeyEpoch;
+            if (!m_lazyMerge || rebase) {
+                rhs.helpConsolidate(); // a lazy rhs may still have pending heaps
+            }
+            if (rebase) {
+                rhs.m_rekeyEpoch = m_rekeyEpoch; // keys of both heaps must be for the same epoch
+                rhs.m_heap = rhs.helpRebuild(rhs.m_heap, true);
+            }
+            if (m_itemIndex && rhs.m_itemIndex) { // both indexes stay usable
+                for (int i = 0; i < NUMITEMS; i++) {
+                    m_items[i] = helpItemMerge(m_items[i], rhs.m_items[i]);
+                    rhs.m_items[i] = nullptr;
+                }
+                rhs.m_itemIndex = false;
+            }
+            else {
+                helpDropItemIndex();
+                rhs.helpDropItemIndex();
+            }
+            // merged orders were admitted by rhs, they count but are not checked again
+            if (!m_outstanding.empty()) {
+                if (!rhs.m_outstanding.empty() && rhs.m_size >= NUMCUSTOMERS) {
+                    for (int i = 0; i < NUMCUSTOMERS; i++) {
+                        m_outstanding[i] += rhs.m_outstanding[i];
+                    }
+                }
+                else {
+                    helpCountOrders(rhs.m_heap, m_outstanding, 1);
+                    for (unsigned int i = 0; i < rhs.m_pending.size(); i++) {
+                        helpCountOrders(rhs.m_pending[i], m_outstanding, 1);
+                    }
+                }
+            }
+            rhs.helpForgetOrders();
+            // A small rhs without an index is copied into our blocks, so merging
+            // many small queues doesn't leave a mostly empty block behind each.
+            // Otherwise its blocks move over and the handles stay as they are.
+            if (!m_itemIndex && rhs.m_size < ORDERBLOCK / 8) {
+                helpMoveOrders(rhs);
+            }
+            else {
+                m_store.take(rhs.m_store);
+            }
+            m_pool.take(rhs.m_pool); // the nodes come along with their blocks
+            // ties between the two queues go by their own sequence numbers
+            if (rhs.m_sequence > m_sequence) {
+                m_sequence = rhs.m_sequence;
+            }
+            if (!m_lazyMerge) {
+                m_heap = helpMeld(m_heap, rhs.m_heap); // calls help merge
+            }
+            else if (m_heap == nullptr) { // nothing to wait for
+                m_heap = rhs.m_heap;
+                m_pending.swap(rhs.m_pending);
+            }
+            else { // melded by helpConsolidate when the root is needed
+                if (rhs.m_heap != nullptr) {
+                    m_pending.push_back(rhs.m_heap);
+                }
+                m_pending.insert(m_pending.end(), rhs.m_pending.begin(), rhs.m_pending.end());
+            }
             m_size = rhs.m_size + m_size;
+            CQUEUE_STAT(m_stats.m_merges += 1;)
             rhs.m_heap = nullptr; // rhs should be empty
+            rhs.m_pending.clear();
             rhs.m_size = 0;
+            rhs.helpSetConfig(config);
         }
     }
     else{
-        throw domain_error("the priority function and the structure aren't the same"); // throw domainn error
+        throw domain_error("there are no orders to merge"); // throw domainn error
     }
 
 }
+void CQueue::setLazyMerge(bool lazy) {
+    m_lazyMerge = lazy;
+    if (!lazy) {
+        helpConsolidate();
+    }
+}
+bool CQueue::getLazyMerge() const {
+    return m_lazyMerge;
+}
+// The orders and nodes of every queue move into the new one first, on the
+// calling thread, so each store and pool is handed over once. Then the
+// heaps, pending ones included, are melded pairwise in a balanced
+// tournament. Aged keys are brought to the epoch of the first queue
+// beforehand.
+CQueue CQueue::mergeAll(span<CQueue*> queues, bool parallel) {
+    if (queues.empty()) {
+        throw out_of_range("no queues to merge");
+    }
+    if (find(queues.begin(), queues.end(), nullptr) != queues.end()) {
+        throw invalid_argument("a queue is missing");
+    }
+    CQueue *first = queues[0];
+    vector<CQueue*> sorted(queues.begin(), queues.end());
+    sort(sorted.begin(), sorted.end());
+    if (adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+        throw domain_error("a queue is listed twice");
+    }
+    for (unsigned int i = 0; i < queues.size(); i++) {
+        if (!first->helpMergeable(*queues[i])) {
+            throw domain_error("the priority function, the heap type, the structure or the aging aren't the same");
+        }
+    }
+    CQueue result = first->helpWorker();
+    result.setAdmission(first->m_maxOutstanding, first->m_tokenRate, first->m_tokenBurst);
+    if (result.m_tokenRate > 0) { // a customer keeps the fewest tokens any queue left it
+        long long now = currentEpoch();
+        for (unsigned int i = 0; i < queues.size(); i++) {
+            if (queues[i]->m_tokens.empty()) {
+                continue;
+            }
+            for (int c = 0; c < NUMCUSTOMERS; c++) {
+                long long tokens = queues[i]->m_tokens[c] + (now - queues[i]->m_refillEpoch[c]) * result.m_tokenRate;
+                if (tokens < result.m_tokens[c]) {
+                    result.m_tokens[c] = (int)tokens;
+                }
+            }
+        }
+    }
+    result.m_compactThreshold = first->m_compactThreshold;
+    vector<Node*> roots;
+    for (unsigned int i = 0; i < queues.size(); i++) {
+        CQueue *queue = queues[i];
+        if (queue->m_size == 0) { // nodes taken by getNextBatch alone stay behind
+            continue;
+        }
+        queue->helpFinishRekey();
+        if ((queue->m_agingCurve != nullptr || queue->m_agingWeight != 0) && queue->m_rekeyEpoch != first->m_rekeyEpoch) {
+            queue->helpConsolidate();
+            queue->m_rekeyEpoch = first->m_rekeyEpoch;
+            queue->m_heap = queue->helpRebuild(queue->m_heap, true);
+        }
+        queue->helpDropItemIndex(); // the new queue builds its own
+        if (!result.m_outstanding.empty()) { // admitted by their queue, they count but are not checked again
+            if (!queue->m_outstanding.empty() && queue->m_size >= NUMCUSTOMERS) {
+                for (int c = 0; c < NUMCUSTOMERS; c++) {
+                    result.m_outstanding[c] += queue->m_outstanding[c];
+                }
+            }
+            else {
+                result.helpCountOrders(queue->m_heap, result.m_outstanding, 1);
+                for (unsigned int p = 0; p < queue->m_pending.size(); p++) {
+                    result.helpCountOrders(queue->m_pending[p], result.m_outstanding, 1);
+                }
+            }
+        }
+        queue->helpForgetOrders();
+        if (queue->m_size < ORDERBLOCK / 8) { // small ones are copied, as by mergeWithQueue
+            result.helpMoveOrders(*queue);
+        }
+        else {
+            result.m_store.take(queue->m_store);
+        }
+        result.m_pool.take(queue->m_pool);
+        if (queue->m_sequence > result.m_sequence) {
+            result.m_sequence = queue->m_sequence;
+        }
+        if (queue->m_heap != nullptr) {
+            roots.push_back(queue->m_heap);
+        }
+        roots.insert(roots.end(), queue->m_pending.begin(), queue->m_pending.end());
+        result.m_size += queue->m_size;
+        CQUEUE_STAT(result.m_stats.m_merges += 1;)
+        queue->m_heap = nullptr;
+        queue->m_pending.clear();
+        queue->m_size = 0;
+    }
+    CQUEUE_STAT(result.m_stats.m_melds += roots.size() > 1 ? roots.size() - 1 : 0;)
+    if (parallel && roots.size() > 1 && ThreadPool::shared().size() > 1) {
+        vector<CQueue> workers(roots.size() / 2, result.helpWorker());
+        result.m_heap = result.helpParallelMeld(roots, workers);
+        result.helpAddStats(workers);
+    }
+    else {
+        result.m_heap = result.helpHeapify(roots.data(), (int)roots.size());
+    }
+    result.m_lazyMerge = first->m_lazyMerge;
+    return result;
+}
+// builds one heap per backlog on the pool, checking the IDs like insertOrder
+void CQueue::bulkLoad(const vector<vector<Order> >& backlogs) {
+    CQUEUE_LATENCY_SCOPE(m_structure, BULKLOAD);
+    CQUEUE_TRACE_SCOPE(BULKLOAD, m_size, 0);
+    helpCheckRekey(); // the workers key for the current base
+    int count = (int)backlogs.size();
+    vector<CQueue> workers(count, helpWorker());
+    vector<Node*> roots(count);
+    vector<int> sizes(count);
+    vector<unsigned int> sequences(count); // backlogs are numbered one after the other
+    unsigned int total = 0;
+    for (int b = 0; b < count; b++) {
+        sequences[b] = total;
+        total += (unsigned int)backlogs[b].size();
+    }
+    unsigned int first = helpSequence(total);
+    long long epoch = currentEpoch();
+    // the store is filled and the nodes are allocated here, in one run, and
+    // they are built on the pool
+    vector<vector<unsigned int> > handles(count);
+    vector<int> offsets(count); // first node of each backlog in the run
+    int nodeCount = 0;
+    for (int b = 0; b < count; b++) {
+        offsets[b] = nodeCount;
+        handles[b].reserve(backlogs[b].size());
+        for (unsigned int i = 0; i < backlogs[b].size(); i++) {
+            const Order& order = backlogs[b][i];
+            if (order.m_customerID >= MINCUSTID && order.m_customerID <= MAXCUSTID &&
+                order.m_orderID >= MINORDERID && order.m_orderID <= MAXORDERID) {
+                handles[b].push_back(m_store.add(order, epoch));
+            }
+        }
+        nodeCount += (int)handles[b].size();
+    }
+    Node *run = m_pool.allocateRun(nodeCount);
+    ThreadPool::shared().parallelFor(count, [&](int b) {
+        vector<Node*> nodes;
+        nodes.reserve(handles[b].size());
+        for (unsigned int i = 0; i < handles[b].size(); i++) {
+            Node *node = new (run + offsets[b] + i) Node(handles[b][i]);
+            node->m_key = first + sequences[b] + i; // the sequence, helpRekey adds the priority
+            nodes.push_back(node);
+        }
+        workers[b].helpRekey(nodes.data(), (int)nodes.size());
+        sizes[b] = (int)nodes.size();
+        roots[b] = workers[b].helpHeapify(nodes.data(), (int)nodes.size());
+    });
+    Node *loaded = helpParallelMeld(roots, workers);
+    helpAddStats(workers);
+    if (m_itemIndex) { // the new orders join the item heaps, a tick of a timer doesn't cost a rebuild
+        helpIndexRun(run, nodeCount);
+    }
+    m_heap = helpMeld(m_heap, loaded);
+    if (!m_outstanding.empty()) { // backlogs bypass admission but count toward the limits
+        for (int b = 0; b < count; b++) {
+            for (unsigned int i = 0; i < backlogs[b].size(); i++) {
+                const Order& order = backlogs[b][i];
+                if (order.m_customerID >= MINCUSTID && order.m_customerID <= MAXCUSTID &&
+                    order.m_orderID >= MINORDERID && order.m_orderID <= MAXORDERID) {
+                    m_outstanding[order.m_customerID - MINCUSTID] += 1;
+                }
+            }
+        }
+    }
+    for (int b = 0; b < count; b++) {
+        m_size += sizes[b];
+        CQUEUE_STAT(m_stats.m_inserts += sizes[b];)
+    }
+}
+// splits the batch into one chunk per pool thread, each computes the
+// priorities of its valid orders block by block and builds a heap of them
+void CQueue::bulkLoad(const OrderBatch& batch) {
+    CQUEUE_LATENCY_SCOPE(m_structure, BULKLOAD);
+    CQUEUE_TRACE_SCOPE(BULKLOAD, m_size, 0);
+    helpCheckRekey(); // the workers key for the current base
+    int total = batch.size();
+    int chunks = total >= PARALLELREBUILD ? ThreadPool::shared().size() : 1;
+    vector<CQueue> workers(chunks, helpWorker());
+    vector<Node*> roots(chunks);
+    vector<int> sizes(chunks);
+    unsigned int first = helpSequence((unsigned int)total);
+    long long epoch = currentEpoch();
+    vector<unsigned int> handles(total, NOORDER); // NOORDER for the rows with invalid IDs
+    vector<int> offsets(chunks); // first node of each chunk in the run
+    int nodeCount = 0;
+    for (int c = 0; c < chunks; c++) {
+        offsets[c] = nodeCount;
+        int high = (int)((long long)total * (c + 1) / chunks);
+        for (int row = (int)((long long)total * c / chunks); row < high; row++) {
+            if (batch.m_customerIDs[row] >= MINCUSTID && batch.m_customerIDs[row] <= MAXCUSTID &&
+                batch.m_orderIDs[row] >= MINORDERID && batch.m_orderIDs[row] <= MAXORDERID) {
+                handles[row] = m_store.add(batch.getOrder(row), epoch);
+                nodeCount += 1;
+            }
+        }
+    }
+    Node *run = m_pool.allocateRun(nodeCount);
+    ThreadPool::shared().parallelFor(chunks, [&](int c) {
+        int low = (int)((long long)total * c / chunks);
+        int high = (int)((long long)total * (c + 1) / chunks);
+        Node *next = run + offsets[c];
+        vector<Node*> nodes;
+        nodes.reserve(high - low);
+        int priorities[PRIORITYBLOCK];
+        for (int start = low; start < high; start += PRIORITYBLOCK) {
+            int block = high - start < PRIORITYBLOCK ? high - start : PRIORITYBLOCK;
+            workers[c].helpPriorities(batch, start, block, priorities);
+            for (int i = 0; i < block; i++) {
+                int row = start + i;
+                if (handles[row] != NOORDER) {
+                    Node *node = new (next++) Node(handles[row]);
+                    node->m_key = workers[c].helpPackKey(priorities[i], epoch, first + row);
+                    nodes.push_back(node);
+                }
+            }
+        }
+        sizes[c] = (int)nodes.size();
+        roots[c] = workers[c].helpHeapify(nodes.data(), (int)nodes.size());
+    });
+    Node *loaded = helpParallelMeld(roots, workers);
+    helpAddStats(workers);
+    if (m_itemIndex) { // the new orders join the item heaps, a tick of a timer doesn't cost a rebuild
+        helpIndexRun(run, nodeCount);
+    }
+    m_heap = helpMeld(m_heap, loaded);
+    if (!m_outstanding.empty()) { // the batch bypasses admission but counts toward the limits
+        for (int row = 0; row < total; row++) {
+            if (handles[row] != NOORDER) {
+                m_outstanding[batch.m_customerIDs[row] - MINCUSTID] += 1;
+            }
+        }
+    }
+    for (int c = 0; c < chunks; c++) {
+        m_size += sizes[c];
+        CQUEUE_STAT(m_stats.m_inserts += sizes[c];)
+    }
+}
 // insert all the orders
-void CQueue::insertOrder(const Order& order) {
-    if(order.m_customerID >= MINCUSTID && order.m_customerID <= MAXCUSTID) { // checks valid customer id
-        if (order.m_orderID >= MINORDERID && order.m_orderID <= MAXORDERID) { // checks valid order id
-            Node *curr = new Node(order);
-            m_heap = helpMerge(m_heap, curr);
-            m_size += 1; // increment size
+ADMISSION CQueue::insertOrder(const Order& order) {
+    CQUEUE_LATENCY_SCOPE(m_structure, INSERTORDER);
+    CQUEUE_TRACE_SCOPE(INSERTORDER, m_size, order.m_orderID);
+    ADMISSION status = helpAdmit(order);
+    if (status == ADMITTED) {
+        helpCheckRekey();
+        long long epoch = currentEpoch();
+        Node *curr = m_pool.allocate(m_store.add(order, epoch));
+        curr->m_key = helpKey(order, epoch, helpSequence(1));
+        m_heap = helpMeld(m_heap, curr);
+        if (m_itemIndex) {
+            curr->m_indexed = true;
+            m_items[order.m_item] = helpItemMerge(m_items[order.m_item], curr);
         }
+        m_size += 1; // increment size
+        CQUEUE_STAT(m_stats.m_inserts += 1;)
     }
+    return status;
 }
 // removes a node but returns it order
 Order CQueue::getNextOrder() {
-    if (m_heap == nullptr) { // if the heap is empty throw exception
+    if (m_size == 0) { // if the heap is empty throw exception
         throw out_of_range("the queue is empty");
     }
-    Node * temp = m_heap; // hold m heap
-    Order order = temp->m_order; // hold the order
-    m_heap = helpMerge(m_heap->m_left, m_heap->m_right); // merges
+    CQUEUE_LATENCY_SCOPE(m_structure, NEXTORDER);
+    CQUEUE_TRACE_SCOPE(NEXTORDER, m_size, 0);
+    helpCheckRekey();
+    Node * temp = helpPopRoot(); // hold m heap
+    Order order = OrderStore::get(temp->m_handle); // materialise the order
+    CQUEUE_TRACE_ORDER(order.m_orderID);
     m_size -= 1;
-    delete temp;
+    if (!m_outstanding.empty()) {
+        m_outstanding[order.m_customerID - MINCUSTID] -= 1;
+    }
+    CQUEUE_STAT(m_stats.m_pops += 1;)
+    helpRelease(temp);
     return order; // return order
 }
+// orders taken by a batch are dropped from the top so the root is live
+long long CQueue::getTopKey() {
+    if (m_size == 0) {
+        throw out_of_range("the queue is empty");
+    }
+    helpCheckRekey();
+    helpConsolidate();
+    if (m_stale != nullptr && m_agingCurve != nullptr) { // as in helpPopRoot
+        helpFinishRekey();
+    }
+    while (m_heap->m_taken) {
+        Node *temp = m_heap;
+        m_heap = helpMeld(m_heap->m_left, m_heap->m_right);
+        if (m_heap == nullptr && m_stale != nullptr) {
+            helpMigrate(1);
+        }
+        helpFree(temp);
+    }
+    long long key = (long long)(m_heap->m_key >> 32) + INT_MIN;
+    return m_heapType == MINHEAP ? key : -key;
+}
+// pops the best order, then keeps taking orders for the same item from the
+// per-item index while they fit. Those stay in the main heap marked as taken.
+vector<Order> CQueue::getNextBatch(int maxUnits) {
+    vector<Order> batch;
+    batch.push_back(getNextOrder()); // throws when empty
+    if (!m_itemIndex) {
+        helpBuildItemIndex();
+    }
+    int item = batch[0].m_item;
+    int units = batch[0].getUnits();
+    helpPurgeItem(item);
+    while (m_items[item] != nullptr && units + OrderStore::get(m_items[item]->m_handle).getUnits() <= maxUnits) {
+        Node *node = m_items[item];
+        m_items[item] = helpItemMerge(node->m_itemLeft, node->m_itemRight);
+        node->m_itemLeft = nullptr;
+        node->m_itemRight = nullptr;
+        node->m_indexed = false;
+        node->m_taken = true;
+        batch.push_back(OrderStore::get(node->m_handle));
+        units += batch.back().getUnits();
+        m_size -= 1;
+        if (!m_outstanding.empty()) {
+            m_outstanding[batch.back().m_customerID - MINCUSTID] -= 1;
+        }
+        CQUEUE_STAT(m_stats.m_pops += 1;)
+        helpPurgeItem(item);
+    }
+    return batch;
+}
 // changing priority and heap type
 void CQueue::setPriorityFn(prifn_t priFn, HEAPTYPE heapType) {
+    CQUEUE_LATENCY_SCOPE(m_structure, REBUILDHEAP);
+    CQUEUE_TRACE_SCOPE(REBUILDHEAP, m_size, 0);
     m_priorFunc = priFn; // sets them
     m_heapType = heapType;
-    Node * temp = m_heap;
-    m_heap = nullptr;
-    m_size = 0; // important to set size to 0
-    helpRebuild(temp); // calls a function to rebuild it
+    helpConsolidate();
+    helpFinishRekey();
+    m_heap = helpRebuild(m_heap, true); // calls a function to rebuild it
+    CQUEUE_STAT(m_stats.m_rebuilds += 1;)
+}
+// same as above with a compiled table
+void CQueue::setPriorityFn(const PriorityTable& table, HEAPTYPE heapType) {
+    CQUEUE_LATENCY_SCOPE(m_structure, REBUILDHEAP);
+    CQUEUE_TRACE_SCOPE(REBUILDHEAP, m_size, 0);
+    m_priorFunc = nullptr;
+    m_priorTable = table;
+    m_heapType = heapType;
+    helpConsolidate();
+    helpFinishRekey();
+    m_heap = helpRebuild(m_heap, true);
+    CQUEUE_STAT(m_stats.m_rebuilds += 1;)
 }
 // changing the structure
 void CQueue::setStructure(STRUCTURE structure){
+    CQUEUE_LATENCY_SCOPE(structure, REBUILDHEAP);
+    CQUEUE_TRACE_SCOPE(REBUILDHEAP, m_size, 0);
     m_structure = structure;
-    Node * temp = m_heap;
-    m_heap = nullptr;
-    m_size = 0;
-    helpRebuild(temp); // calls a function to rebuild it
+    helpConsolidate();
+    helpFinishRekey();
+    m_heap = helpRebuild(m_heap, false); // calls a function to rebuild it
+    CQUEUE_STAT(m_stats.m_rebuilds += 1;)
+}
+// linear aging, the heap is rebuilt with the new keys
+void CQueue::setAging(int weight) {
+    CQUEUE_LATENCY_SCOPE(m_structure, REBUILDHEAP);
+    CQUEUE_TRACE_SCOPE(REBUILDHEAP, m_size, 0);
+    m_agingWeight = weight;
+    m_agingCurve = nullptr;
+    m_rekeyEpoch = helpAgingBase(currentEpoch());
+    helpConsolidate();
+    helpFinishRekey();
+    m_heap = helpRebuild(m_heap, true);
+    CQUEUE_STAT(m_stats.m_rebuilds += 1;)
+}
+// non-linear aging, keys are computed for the current epoch
+void CQueue::setAgingCurve(agefn_t curve, int rekeyInterval) {
+    CQUEUE_LATENCY_SCOPE(m_structure, REBUILDHEAP);
+    CQUEUE_TRACE_SCOPE(REBUILDHEAP, m_size, 0);
+    m_agingWeight = 0;
+    m_agingCurve = curve;
+    m_rekeyInterval = rekeyInterval > 0 ? rekeyInterval : 1;
+    m_rekeyEpoch = currentEpoch();
+    helpConsolidate();
+    helpFinishRekey();
+    m_heap = helpRebuild(m_heap, true);
+    CQUEUE_STAT(m_stats.m_rebuilds += 1;)
+}
+int CQueue::getAgingWeight() const {
+    return m_agingWeight;
+}
+agefn_t CQueue::getAgingCurve() const {
+    return m_agingCurve;
+}
+void CQueue::rekey() {
+    if (m_agingCurve != nullptr) {
+        CQUEUE_LATENCY_SCOPE(m_structure, REBUILDHEAP);
+        CQUEUE_TRACE_SCOPE(REBUILDHEAP, m_size, 0);
+        m_rekeyEpoch = currentEpoch();
+        helpConsolidate();
+        helpFinishRekey();
+        m_heap = helpRebuild(m_heap, true);
+        CQUEUE_STAT(m_stats.m_rebuilds += 1;)
+    }
+}
+void CQueue::advanceEpoch(long long epochs) {
+    m_epochClock.fetch_add(epochs, memory_order_relaxed);
+}
+long long CQueue::currentEpoch() {
+    return m_epochClock.load(memory_order_relaxed);
 }
 
 STRUCTURE CQueue::getStructure() const {
@@ -103,35 +655,305 @@ HEAPTYPE CQueue::getHeapType() const {
 prifn_t CQueue::getPriorityFn() const {
     return m_priorFunc;
 }
+PriorityTable CQueue::getPriorityTable() const {
+    return m_priorTable;
+}
 // prints the order in the queue with a helper
-void CQueue::printOrdersQueue() const { //
-    helpPrintOrders(m_heap, m_heap->m_order);
+void CQueue::printOrdersQueue() const { // stale and pending heaps follow the main heap
+    helpPrintOrders(m_heap);
+    helpPrintOrders(m_stale);
+    for (unsigned int i = 0; i < m_pending.size(); i++) {
+        helpPrintOrders(m_pending[i]);
+    }
 }
 // returns the size
 int CQueue::numOrders() const {
     return m_size;
 }
 
+void CQueue::setAdmission(int maxOutstanding, int tokensPerEpoch, int burst) {
+    if (maxOutstanding < 0 || tokensPerEpoch < 0 || burst < 0 || (tokensPerEpoch > 0 && burst == 0)) {
+        throw out_of_range("admission limits must not be negative, a rate needs a burst");
+    }
+    m_maxOutstanding = maxOutstanding;
+    m_tokenRate = tokensPerEpoch;
+    m_tokenBurst = burst;
+    if (maxOutstanding == 0 && tokensPerEpoch == 0) {
+        vector<int>().swap(m_outstanding); // frees the arrays
+        vector<int>().swap(m_tokens);
+        vector<long long>().swap(m_refillEpoch);
+        return;
+    }
+    if (m_outstanding.empty()) { // starts counting the orders already queued
+        m_outstanding.assign(NUMCUSTOMERS, 0);
+        helpConsolidate();
+        helpCountOrders(m_heap, m_outstanding, 1);
+        helpCountOrders(m_stale, m_outstanding, 1);
+    }
+    if (tokensPerEpoch > 0) { // every bucket starts full
+        m_tokens.assign(NUMCUSTOMERS, burst);
+        m_refillEpoch.assign(NUMCUSTOMERS, currentEpoch());
+    }
+    else {
+        vector<int>().swap(m_tokens);
+        vector<long long>().swap(m_refillEpoch);
+    }
+}
+int CQueue::getOutstanding(int customerID) const {
+    if (customerID < MINCUSTID || customerID > MAXCUSTID) {
+        throw out_of_range("customer ID out of range");
+    }
+    if (m_outstanding.empty()) {
+        throw domain_error("admission control is off");
+    }
+    return m_outstanding[customerID - MINCUSTID];
+}
+ADMISSION CQueue::admit(const Order& order) {
+    return helpAdmit(order);
+}
+// a count lost by setAdmission turning admission off and on is not taken twice
+void CQueue::withdraw(const Order& order) {
+    if (m_outstanding.empty() || order.m_customerID < MINCUSTID || order.m_customerID > MAXCUSTID) {
+        return;
+    }
+    if (m_outstanding[order.m_customerID - MINCUSTID] > 0) {
+        m_outstanding[order.m_customerID - MINCUSTID] -= 1;
+    }
+}
+// The nodes are collected spine by spine: the right spine of the root,
+// then the right spine of each left child met so far, in order. Orders
+// only the item index still links come last. The copies are put in a new
+// block, each old node then forwards to its copy through m_right while the
+// links of the copies are rewritten, and the old blocks are freed.
+void CQueue::compact() {
+    helpConsolidate();
+    helpFinishRekey();
+    vector<Node*> nodes;
+    nodes.reserve(m_pool.live());
+    for (Node *curr = m_heap; curr != nullptr; curr = curr->m_right) {
+        nodes.push_back(curr);
+    }
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        for (Node *curr = nodes[i]->m_left; curr != nullptr; curr = curr->m_right) {
+            nodes.push_back(curr);
+        }
+    }
+    if (m_itemIndex) {
+        vector<Node*> stack;
+        for (int i = 0; i < NUMITEMS; i++) {
+            if (m_items[i] != nullptr) {
+                stack.push_back(m_items[i]);
+            }
+        }
+        while (!stack.empty()) {
+            Node *curr = stack.back();
+            stack.pop_back();
+            if (curr->m_taken) { // left the main heap, the spines did not reach it
+                nodes.push_back(curr);
+            }
+            if (curr->m_itemLeft != nullptr) {
+                stack.push_back(curr->m_itemLeft);
+            }
+            if (curr->m_itemRight != nullptr) {
+                stack.push_back(curr->m_itemRight);
+            }
+        }
+    }
+    NodePool pool;
+    Node *block = pool.allocateRun((int)nodes.size());
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        new (block + i) Node(*nodes[i]);
+    }
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        nodes[i]->m_right = block + i;
+    }
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        Node *curr = block + i;
+        if (!curr->m_indexed) { // the index links are stale
+            curr->m_itemLeft = nullptr;
+            curr->m_itemRight = nullptr;
+        }
+        Node **links[] = {&curr->m_left, &curr->m_right, &curr->m_itemLeft, &curr->m_itemRight};
+        for (int j = 0; j < 4; j++) {
+            if (*links[j] != nullptr) {
+                *links[j] = (*links[j])->m_right;
+            }
+        }
+    }
+    if (m_heap != nullptr) {
+        m_heap = m_heap->m_right;
+    }
+    for (int i = 0; i < NUMITEMS; i++) {
+        if (m_items[i] != nullptr) {
+            m_items[i] = m_items[i]->m_right;
+        }
+    }
+    m_pool.clear();
+    m_pool.take(pool);
+    CQUEUE_STAT(m_stats.m_compactions += 1;)
+}
+void CQueue::setCompaction(double threshold) {
+    if (threshold < 0 || threshold > 1) {
+        throw out_of_range("the compaction threshold must be between 0 and 1");
+    }
+    m_compactThreshold = threshold;
+}
+bool CQueue::maybeCompact() {
+    bool shrink = m_pool.capacity() > NODEBLOCKMAX && m_pool.live() < m_pool.capacity() / 4;
+    if (!shrink && (m_compactThreshold == 0 || m_pool.fragmentation() < m_compactThreshold)) {
+        return false;
+    }
+    compact(); // the copy takes one block of the live nodes
+    return true;
+}
+double CQueue::getFragmentation() const {
+    return m_pool.fragmentation();
+}
 void CQueue::dump() const {
     if (m_size == 0) {
         cout << "Empty heap.\n" ;
     } else {
         dump(m_heap);
+        if (m_stale != nullptr) {
+            dump(m_stale);
+        }
+        for (unsigned int i = 0; i < m_pending.size(); i++) {
+            dump(m_pending[i]);
+        }
     }
     cout << endl;
 }
+// in order with an explicit stack, each node is visited three times: to
+// open it, to print it after its left subtree and to close it after its right
 void CQueue::dump(Node *pos) const {
-    if ( pos != nullptr ) {
-        cout << "(";
-        dump(pos->m_left);
-        if (m_structure == SKEW)
-            cout << m_priorFunc(pos->m_order) << ":" << pos->m_order.getOrderID();
-        else
-            cout << m_priorFunc(pos->m_order) << ":" << pos->m_order.getOrderID() << ":" << pos->m_npl;
-        dump(pos->m_right);
-        cout << ")";
+    vector<pair<Node*, int> > stack;
+    if (pos != nullptr) {
+        stack.push_back(make_pair(pos, 0));
+    }
+    while (!stack.empty()) {
+        pos = stack.back().first;
+        int visit = stack.back().second;
+        stack.pop_back();
+        if (visit == 0) {
+            cout << "(";
+            stack.push_back(make_pair(pos, 1));
+            if (pos->m_left != nullptr) {
+                stack.push_back(make_pair(pos->m_left, 0));
+            }
+        }
+        else if (visit == 1) {
+            if (pos->m_taken) // handed out in a batch, not unlinked yet
+                cout << "*";
+            Order order = OrderStore::get(pos->m_handle);
+            if (m_structure == SKEW)
+                cout << helpPriority(order) << ":" << order.getOrderID();
+            else
+                cout << helpPriority(order) << ":" << order.getOrderID() << ":" << pos->m_npl;
+            stack.push_back(make_pair(pos, 2));
+            if (pos->m_right != nullptr) {
+                stack.push_back(make_pair(pos->m_right, 0));
+            }
+        }
+        else {
+            cout << ")";
+        }
     }
 }
+#ifdef CQUEUE_STATS
+// copies the counters and walks the heap to fill in the shape statistics
+CQueueStats CQueue::getStats() const {
+    CQueueStats stats = m_stats;
+    stats.m_size = m_size;
+    stats.m_liveBytes = (unsigned long long)m_size * sizeof(Node);
+    // explicit stack, a degenerated skew heap is too deep for recursion
+    vector<pair<Node*, int> > stack;
+    if (m_heap != nullptr) {
+        stack.push_back(make_pair(m_heap, 1));
+    }
+    for (unsigned int i = 0; i < m_pending.size(); i++) { // as if they were melded below the root
+        stack.push_back(make_pair(m_pending[i], 2));
+    }
+    if (m_stale != nullptr) {
+        stack.push_back(make_pair(m_stale, 2));
+    }
+    while (!stack.empty()) {
+        Node *curr = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        if (depth > stats.m_maxDepth) {
+            stats.m_maxDepth = depth;
+        }
+        if (m_structure == LEFTIST) {
+            if ((int)stats.m_nplCounts.size() <= curr->m_npl) {
+                stats.m_nplCounts.resize(curr->m_npl + 1, 0);
+            }
+            stats.m_nplCounts[curr->m_npl] += 1;
+        }
+        if (curr->m_left != nullptr) {
+            stack.push_back(make_pair(curr->m_left, depth + 1));
+        }
+        if (curr->m_right != nullptr) {
+            stack.push_back(make_pair(curr->m_right, depth + 1));
+        }
+    }
+    return stats;
+}
+// writes the stats for a textfile scraper, the file is replaced atomically
+bool CQueue::exportStats(const string& fileName, const string& name) const {
+    CQueueStats stats = getStats();
+    string queue = escapeQuoted(name, false);
+    string labels = "{queue=\"" + queue + "\",structure=\""
+                    + (m_structure == SKEW ? "skew" : "leftist") + "\",heap=\""
+                    + (m_heapType == MINHEAP ? "min" : "max") + "\"}";
+    string tempName = fileName + ".tmp";
+    ofstream out(tempName.c_str());
+    if (!out) {
+        return false;
+    }
+    const char *counters[][2] = {
+        {"cqueue_inserts_total", "Orders inserted."},
+        {"cqueue_pops_total", "Orders removed."},
+        {"cqueue_merges_total", "Queues merged into this queue."},
+        {"cqueue_rebuilds_total", "Heap rebuilds after a priority or structure change."},
+        {"cqueue_compactions_total", "Node pool compactions."},
+        {"cqueue_priority_calls_total", "Priority function invocations."},
+        {"cqueue_melds_total", "Top level heap melds."},
+        {"cqueue_meld_steps_total", "Merge recursions over all melds."}};
+    unsigned long long values[] = {stats.m_inserts, stats.m_pops, stats.m_merges,
+                                   stats.m_rebuilds, stats.m_compactions, stats.m_priorityCalls,
+                                   stats.m_melds, stats.m_meldSteps};
+    for (int i = 0; i < 8; i++) {
+        out << "# HELP " << counters[i][0] << " " << counters[i][1] << "\n"
+            << "# TYPE " << counters[i][0] << " counter\n"
+            << counters[i][0] << labels << " " << values[i] << "\n";
+    }
+    out << "# HELP cqueue_max_meld_depth Longest right spine walked by one meld.\n"
+        << "# TYPE cqueue_max_meld_depth gauge\n"
+        << "cqueue_max_meld_depth" << labels << " " << stats.m_maxMeldDepth << "\n"
+        << "# HELP cqueue_orders Orders in the queue.\n"
+        << "# TYPE cqueue_orders gauge\n"
+        << "cqueue_orders" << labels << " " << stats.m_size << "\n"
+        << "# HELP cqueue_max_depth Depth of the deepest node.\n"
+        << "# TYPE cqueue_max_depth gauge\n"
+        << "cqueue_max_depth" << labels << " " << stats.m_maxDepth << "\n"
+        << "# HELP cqueue_live_node_bytes Bytes held by live nodes.\n"
+        << "# TYPE cqueue_live_node_bytes gauge\n"
+        << "cqueue_live_node_bytes" << labels << " " << stats.m_liveBytes << "\n";
+    if (m_structure == LEFTIST) {
+        out << "# HELP cqueue_npl_nodes Nodes per null path length.\n"
+            << "# TYPE cqueue_npl_nodes gauge\n";
+        for (unsigned int npl = 0; npl < stats.m_nplCounts.size(); npl++) {
+            out << "cqueue_npl_nodes{queue=\"" << queue << "\",npl=\"" << npl << "\"} "
+                << stats.m_nplCounts[npl] << "\n";
+        }
+    }
+    out.close();
+    if (!out) {
+        return false;
+    }
+    return rename(tempName.c_str(), fileName.c_str()) == 0;
+}
+#endif
 ostream& operator<<(ostream& sout, const Order& order) {
     sout << "Order ID: " << order.getOrderID()
          << ", customer ID: " << order.getCustomerID()
@@ -145,128 +967,404 @@ ostream& operator<<(ostream& sout, const Node& node) {
     sout << node.getOrder();
     return sout;
 }
-// helps clear the heap
-void CQueue::helpClear(Node * curr) {
-
-    if(curr != nullptr) { // recursively deletes them
-        helpClear(curr->m_left);
-        helpClear(curr->m_right);
-        delete curr;
+// Checks the IDs, then the customer's outstanding orders, then takes a token.
+// A bucket is refilled lazily for the epochs since the customer's last order.
+ADMISSION CQueue::helpAdmit(const Order& order) {
+    if (order.m_customerID < MINCUSTID || order.m_customerID > MAXCUSTID ||
+        order.m_orderID < MINORDERID || order.m_orderID > MAXORDERID) {
+        return INVALIDID;
     }
-
+    if (m_outstanding.empty()) {
+        return ADMITTED;
+    }
+    int customer = order.m_customerID - MINCUSTID;
+    if (m_maxOutstanding > 0 && m_outstanding[customer] >= m_maxOutstanding) {
+        return CUSTOMERLIMIT;
+    }
+    if (m_tokenRate > 0) {
+        long long now = currentEpoch();
+        long long tokens = m_tokens[customer] + (now - m_refillEpoch[customer]) * m_tokenRate;
+        m_tokens[customer] = (int)(tokens < m_tokenBurst ? tokens : m_tokenBurst);
+        m_refillEpoch[customer] = now;
+        if (m_tokens[customer] == 0) {
+            return RATELIMITED;
+        }
+        m_tokens[customer] -= 1;
+    }
+    m_outstanding[customer] += 1;
+    return ADMITTED;
 }
-// helps copy the entire heap
-Node *CQueue::helpCopy(Node *curr) {
-    Node * temp = nullptr;
+// adds delta to the counter of every order in the heap, taken orders are not in the queue
+void CQueue::helpCountOrders(Node *curr, vector<int>& counts, int delta) {
+    vector<Node*> stack;
     if (curr != nullptr) {
-        temp = new Node(*curr);
-        temp->m_left = helpCopy(curr->m_left);
-        temp->m_right = helpCopy(curr->m_right);
+        stack.push_back(curr);
+    }
+    while (!stack.empty()) {
+        curr = stack.back();
+        stack.pop_back();
+        if (!curr->m_taken) {
+            counts[OrderStore::customerID(curr->m_handle) - MINCUSTID] += delta;
+        }
+        if (curr->m_left != nullptr) {
+            stack.push_back(curr->m_left);
+        }
+        if (curr->m_right != nullptr) {
+            stack.push_back(curr->m_right);
+        }
     }
-    return temp;
 }
-// prints out the orders in the queue
-void CQueue::helpPrintOrders(Node *curr, const Order& order) const {
-    if (curr != nullptr) {
-        cout << "[" <<  m_priorFunc(curr->m_order) << "] "
-             << "Order ID: " << curr->m_order.m_orderID
-             << ", customer ID: " << curr->m_order.m_customerID
-             << ", # of points: " << curr->m_order.m_points
-             << ", membership tier: " << curr->m_order.m_membership
-             << ", item ordered: " << curr->m_order.m_item
-             << ", quantity: " << curr->m_order.m_count << endl;
-        helpPrintOrders(curr->m_left, curr->m_order);
-        helpPrintOrders(curr->m_right, curr->m_order);
-    }
-}
-// this merges the two heap together
-Node *CQueue::helpMerge(Node *curr, Node * temp) {
-    if (m_structure == SKEW) { // checks if it's a skew
-        if (curr != nullptr && temp != nullptr) {
-            if (m_heapType == MINHEAP) { // checks the heap type
-                if (m_priorFunc(curr->m_order) <= m_priorFunc(temp->m_order)) { // priority check
-                    Node *test = curr->m_left;
-                    // swaps
-                    curr->m_left = curr->m_right;
-                    curr->m_right = test;
-                    curr->m_left = helpMerge(curr->m_left, temp);
-                    return curr;
-                } else {
-                    Node *test = temp->m_left;
-                    temp->m_left = temp->m_right;
-                    temp->m_right = test;
-                    temp->m_left = helpMerge(temp->m_left, curr);
-                    return temp;
-                }
+// the orders are about to leave, walks them unless zeroing the array is cheaper
+void CQueue::helpForgetOrders() {
+    if (m_outstanding.empty()) {
+        return;
+    }
+    if (m_size >= NUMCUSTOMERS) {
+        fill(m_outstanding.begin(), m_outstanding.end(), 0);
+    }
+    else {
+        helpCountOrders(m_heap, m_outstanding, -1);
+        helpCountOrders(m_stale, m_outstanding, -1);
+        for (unsigned int i = 0; i < m_pending.size(); i++) {
+            helpCountOrders(m_pending[i], m_outstanding, -1);
+        }
+    }
+}
+// removes the root of the main heap, dropping orders already taken by a batch
+Node *CQueue::helpPopRoot() {
+    helpConsolidate();
+    if (m_stale != nullptr && m_agingCurve != nullptr) { // the curve reorders the stale orders among themselves
+        helpFinishRekey();
+    }
+    while (true) {
+        Node *temp = m_heap;
+        OrderStore::prefetch(temp->m_handle); // on its way while the children are melded
+        m_heap = helpMeld(m_heap->m_left, m_heap->m_right); // merges
+        if (m_heap == nullptr && m_stale != nullptr) { // the rest waits for a re-key
+            helpMigrate(1);
+        }
+        if (!temp->m_taken) {
+            return temp;
+        }
+        helpFree(temp); // taken by a batch, so it is not in the index anymore
+    }
+}
+// a node that left the main heap is freed unless the index still links it
+void CQueue::helpRelease(Node *node) {
+    if (node->m_indexed) {
+        node->m_taken = true;
+        helpPurgeItem(OrderStore::item(node->m_handle));
+    }
+    else {
+        helpFree(node);
+    }
+}
+// skew heap merge over the index links, top down so there is no recursion
+Node *CQueue::helpItemMerge(Node *curr, Node *temp) {
+    Node *root = nullptr;
+    Node **slot = &root;
+    while (curr != nullptr && temp != nullptr) {
+        if (curr->m_key > temp->m_key) {
+            Node *swapped = curr;
+            curr = temp;
+            temp = swapped;
+        }
+        // curr wins, its old right path is merged with temp into its left
+        *slot = curr;
+        Node *next = curr->m_itemRight;
+        curr->m_itemRight = curr->m_itemLeft;
+        curr->m_itemLeft = nullptr;
+        slot = &curr->m_itemLeft;
+        curr = next;
+    }
+    *slot = (curr != nullptr) ? curr : temp;
+    return root;
+}
+// unlinks taken orders from the top of an item heap, they already left the main heap
+void CQueue::helpPurgeItem(int item) {
+    while (m_items[item] != nullptr && m_items[item]->m_taken) {
+        Node *top = m_items[item];
+        m_items[item] = helpItemMerge(top->m_itemLeft, top->m_itemRight);
+        helpFree(top);
+    }
+}
+// links every live order of the main heap into the heap for its item
+void CQueue::helpBuildItemIndex() {
+    helpConsolidate();
+    helpFinishRekey(); // the item heaps are ordered by the fresh keys
+    vector<Node*> items[NUMITEMS];
+    vector<Node*> stack;
+    if (m_heap != nullptr) {
+        stack.push_back(m_heap);
+    }
+    while (!stack.empty()) {
+        Node *curr = stack.back();
+        stack.pop_back();
+        if (!curr->m_taken) {
+            curr->m_indexed = true;
+            curr->m_itemLeft = nullptr;
+            curr->m_itemRight = nullptr;
+            items[OrderStore::item(curr->m_handle)].push_back(curr);
+        }
+        if (curr->m_left != nullptr) {
+            stack.push_back(curr->m_left);
+        }
+        if (curr->m_right != nullptr) {
+            stack.push_back(curr->m_right);
+        }
+    }
+    helpIndexNodes(items);
+    m_itemIndex = true;
+}
+// links the nodes of a run, fresh from bulkLoad, into the built index
+void CQueue::helpIndexRun(Node *run, int count) {
+    vector<Node*> items[NUMITEMS];
+    for (int i = 0; i < count; i++) {
+        run[i].m_indexed = true;
+        items[OrderStore::item(run[i].m_handle)].push_back(run + i);
+    }
+    helpIndexNodes(items);
+}
+// builds a heap per item out of single nodes and melds it into the index
+void CQueue::helpIndexNodes(vector<Node*> items[NUMITEMS]) {
+    for (int i = 0; i < NUMITEMS; i++) { // same pairwise rounds as helpHeapify
+        int count = (int)items[i].size();
+        if (count == 0) {
+            continue;
+        }
+        while (count > 1) {
+            for (int j = 0; j < count / 2; j++) {
+                items[i][j] = helpItemMerge(items[i][2 * j], items[i][2 * j + 1]);
+            }
+            if (count % 2 == 1) {
+                items[i][count / 2] = items[i][count - 1];
             }
-            else { // max heap
-                if (m_priorFunc(curr->m_order) >= m_priorFunc(temp->m_order)) {
-                    Node *test = curr->m_left;
-                    curr->m_left = curr->m_right;
-                    curr->m_right = test;
-                    curr->m_left = helpMerge(curr->m_left, temp);
-                    return curr;
-                } else {
-                    Node *test = temp->m_left;
-                    temp->m_left = temp->m_right;
-                    temp->m_right = test;
-                    temp->m_left = helpMerge(temp->m_left, curr);
-                    return temp;
+            count = (count + 1) / 2;
+        }
+        m_items[i] = helpItemMerge(m_items[i], items[i][0]);
+    }
+}
+// frees the taken orders only the index still held and unlinks the rest
+void CQueue::helpDropItemIndex() {
+    vector<Node*> stack;
+    for (int i = 0; i < NUMITEMS; i++) {
+        if (m_items[i] != nullptr) {
+            stack.push_back(m_items[i]);
+        }
+        m_items[i] = nullptr;
+    }
+    while (!stack.empty()) {
+        Node *curr = stack.back();
+        stack.pop_back();
+        if (curr->m_itemLeft != nullptr) {
+            stack.push_back(curr->m_itemLeft);
+        }
+        if (curr->m_itemRight != nullptr) {
+            stack.push_back(curr->m_itemRight);
+        }
+        if (curr->m_taken) {
+            helpFree(curr);
+        }
+        else {
+            curr->m_itemLeft = nullptr;
+            curr->m_itemRight = nullptr;
+            curr->m_indexed = false;
+        }
+    }
+    m_itemIndex = false;
+}
+// a node whose order leaves the store
+void CQueue::helpFree(Node *node) {
+    m_store.remove(node->m_handle);
+    m_pool.release(node);
+}
+// copies the orders of a small rhs into our store, its blocks are released
+void CQueue::helpMoveOrders(CQueue& rhs) {
+    vector<Node*> stack;
+    if (rhs.m_heap != nullptr) {
+        stack.push_back(rhs.m_heap);
+    }
+    stack.insert(stack.end(), rhs.m_pending.begin(), rhs.m_pending.end());
+    while (!stack.empty()) {
+        Node *curr = stack.back();
+        stack.pop_back();
+        if (curr == nullptr) {
+            continue;
+        }
+        curr->m_handle = m_store.add(OrderStore::get(curr->m_handle), OrderStore::epoch(curr->m_handle));
+        if (curr->m_left != nullptr) {
+            stack.push_back(curr->m_left);
+        }
+        if (curr->m_right != nullptr) {
+            stack.push_back(curr->m_right);
+        }
+    }
+    rhs.m_store.clear();
+}
+// the nodes are about to be freed together, the index just goes
+void CQueue::helpForgetItemIndex() {
+    for (int i = 0; i < NUMITEMS; i++) {
+        m_items[i] = nullptr;
+    }
+    m_itemIndex = false;
+}
+// helps copy the entire heap, the store was copied first. The copy is laid
+// out breadth first. Copies wait in a queue linked through m_itemRight and
+// keep their original in m_itemLeft until they come out, the originals a
+// few places ahead in the queue are prefetched meanwhile. The pool was
+// reset, so the nodes come out adjacent.
+Node *CQueue::helpCopy(Node *curr, int& taken) {
+    if (curr == nullptr) {
+        return nullptr;
+    }
+    const int lookahead = 8;
+    Node *root = m_pool.allocate(0);
+    root->m_itemLeft = curr;
+    Node *head = root;
+    Node *tail = root;
+    Node *ahead = root; // prefetched up to here
+    int distance = 0;   // nodes from head to ahead
+    while (head != nullptr) {
+        Node *temp = head;
+        head = temp->m_itemRight;
+        if (ahead == temp) {
+            ahead = head;
+            distance = 0;
+        }
+        else {
+            distance -= 1;
+        }
+        Node *original = temp->m_itemLeft;
+        *temp = *original;
+        taken += original->m_taken ? 1 : 0;
+        temp->m_handle = m_store.copied(original->m_handle);
+        temp->m_itemLeft = nullptr; // the copy has no index yet
+        temp->m_itemRight = nullptr;
+        temp->m_indexed = false;
+        Node **children[] = {&temp->m_left, &temp->m_right};
+        for (int i = 0; i < 2; i++) {
+            if (*children[i] != nullptr) {
+                Node *child = m_pool.allocate(0);
+                child->m_itemLeft = *children[i];
+                *children[i] = child;
+                if (head == nullptr) {
+                    head = child;
+                    ahead = child;
+                    distance = 0;
                 }
+                else {
+                    tail->m_itemRight = child;
+                }
+                tail = child;
             }
         }
-        else if(curr != nullptr && temp == nullptr) {
-            return curr;
+        while (distance < lookahead && ahead != nullptr && ahead->m_itemRight != nullptr) {
+            ahead = ahead->m_itemRight;
+            distance += 1;
+            __builtin_prefetch(ahead->m_itemLeft);
         }
-        else if(curr == nullptr && temp != nullptr) {
-            return temp;
+    }
+    return root;
+}
+// Nodes a batch took were copied along with their orders, they would only
+// be freed once they surface. Called when there are any, after all handles
+// are translated, since freeing may give a block back and renumber the rest.
+// The pending heaps are melded on the way.
+void CQueue::helpDropTaken() {
+    vector<Node*> nodes;
+    helpDetach(m_heap, nodes);
+    for (unsigned int i = 0; i < m_pending.size(); i++) {
+        vector<Node*> more;
+        helpDetach(m_pending[i], more);
+        nodes.insert(nodes.end(), more.begin(), more.end());
+    }
+    m_pending.clear();
+    m_heap = helpHeapify(nodes.data(), (int)nodes.size());
+    if (m_stale != nullptr) {
+        nodes.clear();
+        helpDetach(m_stale, nodes);
+        m_stale = helpHeapify(nodes.data(), (int)nodes.size());
+        if (m_heap == nullptr) {
+            helpFinishRekey();
         }
-
+    }
+}
+// prints out the orders in the queue in preorder
+void CQueue::helpPrintOrders(Node *curr) const {
+    vector<Node*> stack;
+    if (curr != nullptr) {
+        stack.push_back(curr);
+    }
+    while (!stack.empty()) {
+        curr = stack.back();
+        stack.pop_back();
+        if (!curr->m_taken) { // else already handed out in a batch
+            Order current = OrderStore::get(curr->m_handle);
+            cout << "[" <<  helpPriority(current) << "] "
+                 << "Order ID: " << current.m_orderID
+                 << ", customer ID: " << current.m_customerID
+                 << ", # of points: " << current.m_points
+                 << ", membership tier: " << current.m_membership
+                 << ", item ordered: " << current.m_item
+                 << ", quantity: " << current.m_count << endl;
+        }
+        if (curr->m_right != nullptr) {
+            stack.push_back(curr->m_right);
+        }
+        if (curr->m_left != nullptr) {
+            stack.push_back(curr->m_left);
+        }
+    }
+}
+// this merges the two heap together, keys are packed so that smaller is
+// better for both heap types and equal priorities go first in first out.
+// The right spines of a skew heap can be as long as the heap, so it is
+// merged top down in a loop. Leftist spines are logarithmic, so that one
+// recurses.
+Node *CQueue::helpMerge(Node *curr, Node * temp) {
+    CQUEUE_STAT(m_stats.m_meldSteps += 1;)
+    if (m_structure == SKEW) { // checks if it's a skew
+        Node *root = nullptr;
+        Node **slot = &root;
+        while (curr != nullptr && temp != nullptr) {
+            if (curr->m_key > temp->m_key) { // priority check, the winner goes in curr
+                Node *test = curr;
+                curr = temp;
+                temp = test;
+            }
+            // swaps, the old right child is merged with temp into the left
+            *slot = curr;
+            Node *test = curr->m_right;
+            curr->m_right = curr->m_left;
+            curr->m_left = nullptr;
+            slot = &curr->m_left;
+            curr = test;
+            CQUEUE_STAT(m_stats.m_meldSteps += 1;)
+        }
+        *slot = (curr != nullptr) ? curr : temp;
+        return root;
     }
     if (m_structure == LEFTIST) { // checks leftist
         if (curr != nullptr && temp != nullptr) {
-            if (m_heapType == MINHEAP) {
-                if (m_priorFunc(curr->m_order) <= m_priorFunc(temp->m_order)) { // min heap
-
-                    if (curr->m_left == nullptr) {
-                        curr->m_left = temp;
-                    }
-                    else {
-                        curr->m_right = helpMerge(curr->m_right, temp);
-                        if (curr->m_left->m_npl < curr->m_right->m_npl) { // does npl check before swap
-                            Node *test = curr->m_left;
-                            curr->m_left = curr->m_right;
-                            curr->m_right = test;
-                        }
-                        curr->m_npl = curr->m_right->m_npl + 1; // hanges npl to correct value
-                    }
-
-                    return curr;
-                } else {
+            if (curr->m_key <= temp->m_key) {
 
-                    return helpMerge(temp, curr);
+                if (curr->m_left == nullptr) {
+                    curr->m_left = temp;
                 }
-            }
-            else { // max heap
-                if (m_priorFunc(curr->m_order) >= m_priorFunc(temp->m_order)) {
-                    if (curr->m_left == nullptr) {
-                        curr->m_left = temp;
+                else {
+                    curr->m_right = helpMerge(curr->m_right, temp);
+                    if (curr->m_left->m_npl < curr->m_right->m_npl) { // does npl check before swap
+                        Node *test = curr->m_left;
+                        curr->m_left = curr->m_right;
+                        curr->m_right = test;
                     }
+                    curr->m_npl = curr->m_right->m_npl + 1; // hanges npl to correct value
+                }
 
-                    else {
-                        curr->m_right = helpMerge(curr->m_right, temp);
-                        if (curr->m_left->m_npl < curr->m_right->m_npl) {
-                            Node *test = curr->m_left;
-                            curr->m_left = curr->m_right;
-                            curr->m_right = test;
-                        }
-                        curr->m_npl = curr->m_right->m_npl + 1;
-                    }
+                return curr;
+            } else {
 
-                    return curr;
-                } else {
-                    return helpMerge(temp, curr);
-                }
+                return helpMerge(temp, curr);
             }
         }
         else if(curr != nullptr && temp == nullptr) {
@@ -278,61 +1376,487 @@ Node *CQueue::helpMerge(Node *curr, Node * temp) {
     }
     return nullptr;
 }
-// helps rebuild the heap after the setters
-void CQueue::helpRebuild(Node *curr) {
+// top level merge, records how long the walk down the right spines was
+Node *CQueue::helpMeld(Node *curr, Node *temp) {
+#ifdef CQUEUE_STATS
+    unsigned long long before = m_stats.m_meldSteps;
+    Node *root = helpMerge(curr, temp);
+    unsigned long long depth = m_stats.m_meldSteps - before;
+    m_stats.m_melds += 1;
+    if (depth > m_stats.m_maxMeldDepth) {
+        m_stats.m_maxMeldDepth = depth;
+    }
+    return root;
+#else
+    return helpMerge(curr, temp);
+#endif
+}
+// every priority calculation of the queue goes through here so it can be counted
+int CQueue::helpPriority(const Order& order) const {
+    CQUEUE_STAT(m_stats.m_priorityCalls += 1;)
+    return m_priorFunc != nullptr ? m_priorFunc(order) : m_priorTable(order);
+}
+// computes what a node is ordered by. Aging makes the key smaller, the
+// priority of a MAXHEAP is negated first so smaller is always better. With
+// linear aging the bonus weight * (now - epoch) is the same shift for every
+// node at any time, so only -weight * (epoch - base) is kept, which stays
+// within AGINGSPAN for new orders. The key saturates at the ends of the 32
+// bit range and the sequence fills the low 32 bits.
+unsigned long long CQueue::helpKey(const Order& order, long long epoch, unsigned int sequence) const {
+    return helpPackKey(helpPriority(order), epoch, sequence);
+}
+unsigned long long CQueue::helpPackKey(long long key, long long epoch, unsigned int sequence) const {
+    long long bonus = 0;
+    if (m_agingCurve != nullptr) {
+        bonus = m_agingCurve(m_rekeyEpoch > epoch ? m_rekeyEpoch - epoch : 0);
+    }
+    else {
+        bonus = -(long long)m_agingWeight * (epoch - m_rekeyEpoch);
+    }
+    key = (m_heapType == MINHEAP ? key : -key) - bonus;
+    if (key < INT_MIN) {
+        key = INT_MIN;
+    }
+    else if (key > INT_MAX) {
+        key = INT_MAX;
+    }
+    return ((unsigned long long)(key - INT_MIN) << 32) | sequence;
+}
+// recomputes the keys of detached nodes, they keep their sequence. With a
+// table the order fields are gathered from the store a block at a time and
+// evaluated together.
+void CQueue::helpRekey(Node **nodes, int count) {
+    if (m_priorFunc != nullptr) {
+        for (int i = 0; i < count; i++) {
+            unsigned int handle = nodes[i]->m_handle;
+            nodes[i]->m_key = helpKey(OrderStore::get(handle), OrderStore::epoch(handle), (unsigned int)nodes[i]->m_key);
+        }
+        return;
+    }
+    int items[PRIORITYBLOCK], memberships[PRIORITYBLOCK], counts[PRIORITYBLOCK], points[PRIORITYBLOCK];
+    int priorities[PRIORITYBLOCK];
+    for (int low = 0; low < count; low += PRIORITYBLOCK) {
+        int block = count - low < PRIORITYBLOCK ? count - low : PRIORITYBLOCK;
+        for (int i = 0; i < block; i++) {
+            unsigned int handle = nodes[low + i]->m_handle;
+            items[i] = OrderStore::item(handle);
+            memberships[i] = OrderStore::membership(handle);
+            counts[i] = OrderStore::count(handle);
+            points[i] = OrderStore::points(handle);
+        }
+        m_priorTable.evaluate(items, memberships, counts, points, block, priorities);
+        CQUEUE_STAT(m_stats.m_priorityCalls += block;)
+        for (int i = 0; i < block; i++) {
+            Node *node = nodes[low + i];
+            node->m_key = helpPackKey(priorities[i], OrderStore::epoch(node->m_handle), (unsigned int)node->m_key);
+        }
+    }
+}
+// priorities of a range of a batch, from the columns when the queue uses a table
+void CQueue::helpPriorities(const OrderBatch& batch, int first, int count, int *priorities) const {
+    if (m_priorFunc == nullptr) {
+        m_priorTable.evaluate(batch, first, count, priorities);
+        CQUEUE_STAT(m_stats.m_priorityCalls += count;)
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        priorities[i] = helpPriority(batch.getOrder(first + i));
+    }
+}
+// reserves count sequence numbers, renumbering the queue first if they would wrap
+unsigned int CQueue::helpSequence(unsigned int count) {
+    if (m_sequence > UINT_MAX - count) {
+        helpRenumber();
+        if (m_sequence > UINT_MAX - count) {
+            throw overflow_error("too many orders for the insertion sequence");
+        }
+    }
+    unsigned int first = m_sequence;
+    m_sequence += count;
+    return first;
+}
+// numbers the orders 0 .. n - 1 in the order they come out, so ties keep their order
+void CQueue::helpRenumber() {
+    helpConsolidate();
+    helpFinishRekey();
+    helpDropItemIndex();
+    vector<Node*> nodes;
+    nodes.reserve(m_size);
+    helpDetach(m_heap, nodes);
+    sort(nodes.begin(), nodes.end(), [](const Node *a, const Node *b) {return a->m_key < b->m_key;});
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        nodes[i]->m_key = (nodes[i]->m_key & 0xffffffff00000000ULL) | i;
+    }
+    m_sequence = (unsigned int)nodes.size();
+    m_heap = helpHeapify(nodes.data(), (int)nodes.size());
+}
+// Curve-aged keys are refreshed once the interval has passed, linear ones
+// once the base epoch moves. The heap
+// becomes the stale one and every call moves REKEYSTEP nodes out of it, so
+// no insert re-keys more than that. Pops of a curve-aged queue finish the
+// re-key, see helpPopRoot. Another interval passing before
+// the stale heap is empty waits for it. The item index holds the old keys
+// and is dropped, which costs no more than the getNextBatch that built it.
+void CQueue::helpCheckRekey() {
+    if (m_stale != nullptr) {
+        helpMigrate(REKEYSTEP);
+        return;
+    }
+    long long epoch = m_rekeyEpoch;
+    if (m_agingCurve != nullptr && currentEpoch() - m_rekeyEpoch >= m_rekeyInterval) {
+        epoch = currentEpoch();
+    }
+    else if (m_agingWeight != 0) {
+        epoch = helpAgingBase(currentEpoch());
+    }
+    if (epoch != m_rekeyEpoch) {
+        helpConsolidate();
+        helpDropItemIndex();
+        m_rekeyEpoch = epoch;
+        m_stale = m_heap;
+        m_heap = nullptr;
+        helpMigrate(REKEYSTEP);
+        CQUEUE_STAT(m_stats.m_rebuilds += 1;)
+    }
+}
+// the base of linear offsets, a multiple of AGINGSPAN / weight so queues
+// with the same weight agree on it and merge without re-keying
+long long CQueue::helpAgingBase(long long epoch) const {
+    if (m_agingWeight == 0) {
+        return 0;
+    }
+    long long period = AGINGSPAN / (m_agingWeight > 0 ? m_agingWeight : -(long long)m_agingWeight);
+    return epoch - ((epoch % period) + period) % period;
+}
+// Pops up to count live nodes off the stale heap and melds them into the
+// main one with fresh keys, taken ones are freed. The stale root goes first,
+// so with linear aging a pop right after compares the best stale order by
+// its fresh key.
+void CQueue::helpMigrate(int count) {
+    while (count > 0 && m_stale != nullptr) {
+        Node *node = m_stale;
+        m_stale = helpMeld(node->m_left, node->m_right);
+        if (node->m_taken) {
+            helpFree(node);
+            continue;
+        }
+        node->m_left = nullptr;
+        node->m_right = nullptr;
+        node->m_npl = 0;
+        node->m_key = helpKey(OrderStore::get(node->m_handle), OrderStore::epoch(node->m_handle),
+                              (unsigned int)node->m_key);
+        m_heap = helpMeld(m_heap, node);
+        count -= 1;
+    }
+}
+// re-keys what is left of the stale heap at once, for the operations that walk all nodes anyway
+void CQueue::helpFinishRekey() {
+    if (m_stale == nullptr) {
+        return;
+    }
+    vector<Node*> nodes;
+    helpDetach(m_stale, nodes);
+    m_stale = nullptr;
+    helpRekey(nodes.data(), (int)nodes.size());
+    m_heap = helpMeld(m_heap, helpHeapify(nodes.data(), (int)nodes.size()));
+}
+// whether the heaps of the two queues can be melded as they are
+bool CQueue::helpMergeable(const CQueue& rhs) const {
+    return m_priorFunc == rhs.m_priorFunc && m_heapType == rhs.m_heapType && m_structure == rhs.m_structure
+        && (m_priorFunc != nullptr || m_priorTable == rhs.m_priorTable)
+        && m_agingWeight == rhs.m_agingWeight && m_agingCurve == rhs.m_agingCurve;
+}
+// Rebuilds the heap with the configuration of rhs in linear time and
+// without allocating. The index is dropped, then the nodes are lined up
+// breadth first through m_itemRight, unlinked and re-keyed, taken ones are
+// freed. The first two heaps of the line are melded and the result goes to
+// its end until one heap is left, the same work as helpHeapify's rounds.
+// The keys keep their sequence.
+void CQueue::helpConvert(const CQueue& rhs) {
+    helpConsolidate();
+    helpFinishRekey();
+    helpDropItemIndex();
+    bool rekey = m_priorFunc != rhs.m_priorFunc || (m_priorFunc == nullptr && !(m_priorTable == rhs.m_priorTable))
+                 || m_heapType != rhs.m_heapType || m_agingWeight != rhs.m_agingWeight
+                 || m_agingCurve != rhs.m_agingCurve || m_rekeyEpoch != rhs.m_rekeyEpoch;
+    helpSetConfig(rhs);
+    Node *head = m_heap;
+    Node *tail = m_heap;
+    Node *prev = nullptr; // last node kept in the line
+    if (head != nullptr) {
+        head->m_itemRight = nullptr;
+    }
+    for (Node *curr = head; curr != nullptr; ) {
+        Node *children[] = {curr->m_left, curr->m_right};
+        for (int i = 0; i < 2; i++) {
+            if (children[i] != nullptr) {
+                children[i]->m_itemRight = nullptr;
+                tail->m_itemRight = children[i];
+                tail = children[i];
+            }
+        }
+        curr->m_left = nullptr;
+        curr->m_right = nullptr;
+        curr->m_npl = 0;
+        Node *next = curr->m_itemRight;
+        if (curr->m_taken) { // handed out in a batch, the index is gone
+            if (prev == nullptr) {
+                head = next;
+            }
+            else {
+                prev->m_itemRight = next;
+            }
+            if (tail == curr) {
+                tail = prev;
+            }
+            helpFree(curr);
+        }
+        else {
+            if (rekey) {
+                curr->m_key = helpKey(OrderStore::get(curr->m_handle), OrderStore::epoch(curr->m_handle),
+                                      (unsigned int)curr->m_key);
+            }
+            prev = curr;
+        }
+        curr = next;
+    }
+    while (head != tail) {
+        Node *first = head;
+        Node *second = first->m_itemRight;
+        head = second->m_itemRight;
+        first->m_itemRight = nullptr;
+        second->m_itemRight = nullptr;
+        Node *merged = helpMerge(first, second);
+        if (head == nullptr) {
+            head = merged;
+        }
+        else {
+            tail->m_itemRight = merged;
+        }
+        tail = merged;
+    }
+    m_heap = head;
+    CQUEUE_STAT(m_stats.m_rebuilds += 1;)
+}
+// melds the pending heaps into the main one in pairwise rounds like
+// helpHeapify, a balanced tournament instead of one growing heap
+void CQueue::helpConsolidate() {
+    if (m_pending.empty()) {
+        return;
+    }
+    m_pending.insert(m_pending.begin(), m_heap);
+    CQUEUE_STAT(m_stats.m_melds += m_pending.size() - 1;)
+    m_heap = helpHeapify(m_pending.data(), (int)m_pending.size());
+    m_pending.clear();
+}
+// what the keys and the shape of the heap depend on
+void CQueue::helpSetConfig(const CQueue& rhs) {
+    m_priorFunc = rhs.m_priorFunc;
+    m_priorTable = rhs.m_priorTable;
+    m_heapType = rhs.m_heapType;
+    m_structure = rhs.m_structure;
+    m_agingWeight = rhs.m_agingWeight;
+    m_agingCurve = rhs.m_agingCurve;
+    m_rekeyInterval = rhs.m_rekeyInterval;
+    m_rekeyEpoch = rhs.m_rekeyEpoch;
+}
+// the blocks move over, so the nodes and the handles stay where they are
+void CQueue::helpTake(CQueue& rhs) {
+    m_store.take(rhs.m_store);
+    m_pool.take(rhs.m_pool);
+    m_heap = rhs.m_heap;
+    m_stale = rhs.m_stale;
+    m_pending.swap(rhs.m_pending);
+    m_size = rhs.m_size;
+    m_lazyMerge = rhs.m_lazyMerge;
+    helpSetConfig(rhs);
+    m_sequence = rhs.m_sequence;
+    m_itemIndex = rhs.m_itemIndex;
+    for (int i = 0; i < NUMITEMS; i++) {
+        m_items[i] = rhs.m_items[i];
+        rhs.m_items[i] = nullptr;
+    }
+    m_outstanding = rhs.m_outstanding;
+    m_tokens = rhs.m_tokens; // the buckets stay with both, they refer to the same customers
+    m_refillEpoch = rhs.m_refillEpoch;
+    m_maxOutstanding = rhs.m_maxOutstanding;
+    m_tokenRate = rhs.m_tokenRate;
+    m_tokenBurst = rhs.m_tokenBurst;
+    m_compactThreshold = rhs.m_compactThreshold;
+    CQUEUE_STAT(m_stats = rhs.m_stats;)
+    fill(rhs.m_outstanding.begin(), rhs.m_outstanding.end(), 0);
+    rhs.m_itemIndex = false;
+    rhs.m_heap = nullptr;
+    rhs.m_stale = nullptr;
+    rhs.m_pending.clear();
+    rhs.m_size = 0;
+}
+// an empty queue with the same configuration, for work done on other threads
+CQueue CQueue::helpWorker() const {
+    CQueue worker(m_priorFunc, m_heapType, m_structure);
+    worker.m_priorTable = m_priorTable;
+    worker.m_agingWeight = m_agingWeight;
+    worker.m_agingCurve = m_agingCurve;
+    worker.m_rekeyInterval = m_rekeyInterval;
+    worker.m_rekeyEpoch = m_rekeyEpoch;
+    return worker;
+}
+// helps rebuild the heap after the setters, reuses the nodes instead of reinserting
+Node *CQueue::helpRebuild(Node *curr, bool rekey) {
+    helpDropItemIndex(); // rebuilt by the next getNextBatch
+    vector<Node*> nodes;
+    nodes.reserve(m_size);
+    helpDetach(curr, nodes);
+    if ((int)nodes.size() >= PARALLELREBUILD && ThreadPool::shared().size() > 1) {
+        return helpParallelHeapify(nodes, rekey);
+    }
+    if (rekey) {
+        helpRekey(nodes.data(), (int)nodes.size());
+    }
+    return helpHeapify(nodes.data(), (int)nodes.size());
+}
+// collects the nodes of a heap breadth first and unlinks them, nodes taken by a batch are freed
+void CQueue::helpDetach(Node *curr, vector<Node*>& nodes) {
     if (curr != nullptr) {
-        helpRebuild(curr->m_left);
-        helpRebuild(curr->m_right);
-        insertOrder(curr->m_order);
-        delete curr;
+        nodes.push_back(curr);
+    }
+    for (unsigned int i = 0; i < nodes.size(); i++) { // the vector is the queue
+        Node *node = nodes[i];
+        if (node->m_left != nullptr) {
+            nodes.push_back(node->m_left);
+        }
+        if (node->m_right != nullptr) {
+            nodes.push_back(node->m_right);
+        }
+        node->m_left = nullptr;
+        node->m_right = nullptr;
+        node->m_npl = 0;
+    }
+    unsigned int live = 0;
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        if (nodes[i]->m_taken) {
+            helpFree(nodes[i]);
+        }
+        else {
+            nodes[live++] = nodes[i];
+        }
     }
+    nodes.resize(live);
 }
-// testing the heap property
-bool CQueue::helpHeapProperty(Node * curr) {
-    bool result = true;
-
-    if (curr == nullptr) {
-        return result;
+// builds a heap out of single nodes in linear time by merging neighbours
+// round after round, the array is overwritten with the partial heaps
+Node *CQueue::helpHeapify(Node **nodes, int count) {
+    if (count == 0) {
+        return nullptr;
     }
-
-    if (m_heapType == MINHEAP) { // checks the Heap type
-        // if the first order is greater than it's kids than return false as it should be the opposite
-        if (curr->m_left != nullptr && m_priorFunc(curr->m_order) > m_priorFunc(curr->m_left->m_order)) {
-            result = false;
+    while (count > 1) {
+        for (int i = 0; i < count / 2; i++) {
+            nodes[i] = helpMerge(nodes[2 * i], nodes[2 * i + 1]);
         }
-        if (curr->m_right != nullptr && m_priorFunc(curr->m_order) > m_priorFunc(curr->m_right->m_order)) {
-            result = false;
+        if (count % 2 == 1) {
+            nodes[count / 2] = nodes[count - 1];
         }
+        count = (count + 1) / 2;
     }
-    if (m_heapType == MAXHEAP) {
-        // if the first order is less than it's kids than return false as it should be the opposite
-        if (curr->m_left != nullptr && m_priorFunc(curr->m_order) < m_priorFunc(curr->m_left->m_order)) {
-            result = false;
+    return nodes[0];
+}
+// re-keys and heapifies one chunk per thread, then melds the partial heaps in parallel
+Node *CQueue::helpParallelHeapify(vector<Node*>& nodes, bool rekey) {
+    ThreadPool& pool = ThreadPool::shared();
+    int chunks = pool.size();
+    int count = (int)nodes.size();
+    vector<CQueue> workers(chunks, helpWorker());
+    vector<Node*> roots(chunks);
+    pool.parallelFor(chunks, [&](int c) {
+        int low = (int)((long long)count * c / chunks);
+        int high = (int)((long long)count * (c + 1) / chunks);
+        if (rekey) {
+            workers[c].helpRekey(nodes.data() + low, high - low);
         }
-        if (curr->m_right != nullptr && m_priorFunc(curr->m_order) < m_priorFunc(curr->m_right->m_order)) {
-            result = false;
+        roots[c] = workers[c].helpHeapify(nodes.data() + low, high - low);
+    });
+    Node *root = helpParallelMeld(roots, workers);
+    helpAddStats(workers);
+    return root;
+}
+// melds the heaps pairwise in parallel rounds, a balanced tournament. Every
+// task merges through its own empty worker queue so the statistics counters
+// are never shared between threads, there must be a worker per two heaps.
+Node *CQueue::helpParallelMeld(vector<Node*>& roots, vector<CQueue>& workers) {
+    if (roots.empty()) {
+        return nullptr;
+    }
+    vector<Node*> next(roots.size());
+    for (int heaps = (int)roots.size(); heaps > 1; heaps = (heaps + 1) / 2) {
+        ThreadPool::shared().parallelFor(heaps / 2, [&](int i) {
+            next[i] = workers[i].helpMerge(roots[2 * i], roots[2 * i + 1]);
+        });
+        if (heaps % 2 == 1) {
+            next[heaps / 2] = roots[heaps - 1];
         }
+        roots.swap(next);
     }
-    result = result && helpHeapProperty(curr->m_left); // recurse through
-    result = result && helpHeapProperty(curr->m_right);
-
-    return result;
+    return roots[0];
+}
+// folds the counters of the worker queues into this queue
+void CQueue::helpAddStats(vector<CQueue>& workers) {
+#ifdef CQUEUE_STATS
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        m_stats.m_priorityCalls += workers[i].m_stats.m_priorityCalls;
+        m_stats.m_meldSteps += workers[i].m_stats.m_meldSteps;
+    }
+#else
+    (void)workers;
+#endif
+}
+// testing the heap property, every node against its children
+bool CQueue::helpHeapProperty(Node * curr) {
+    vector<Node*> stack;
+    if (curr != nullptr) {
+        stack.push_back(curr);
+    }
+    while (!stack.empty()) {
+        curr = stack.back();
+        stack.pop_back();
+        int priority = helpPriority(OrderStore::get(curr->m_handle));
+        Node *children[] = {curr->m_left, curr->m_right};
+        for (int i = 0; i < 2; i++) {
+            if (children[i] == nullptr) {
+                continue;
+            }
+            int child = helpPriority(OrderStore::get(children[i]->m_handle));
+            // a child must not come before its parent
+            if ((m_heapType == MINHEAP && priority > child) || (m_heapType == MAXHEAP && priority < child)) {
+                return false;
+            }
+            stack.push_back(children[i]);
+        }
+    }
+    return true;
 }
 // checking the property of Leftist heap
 bool CQueue::helpCheckLeftProperty(Node * curr) {
-    bool result = true;
+    vector<Node*> stack;
     if (curr != nullptr) {
-        result = result && helpCheckLeftProperty(curr->m_left); // recursively go down the tree
-        result = result && helpCheckLeftProperty(curr->m_right);
+        stack.push_back(curr);
+    }
+    while (!stack.empty()) {
+        curr = stack.back();
+        stack.pop_back();
         if (curr->m_left == nullptr && curr->m_right != nullptr) { // should be something on the left of a Leftist heap
-            result = false;
+            return false;
         }
         if(curr->m_left != nullptr && curr->m_right != nullptr && curr->m_left->m_npl < curr->m_right->m_npl) {
-            result = false;
+            return false;
+        }
+        if (curr->m_left != nullptr) {
+            stack.push_back(curr->m_left);
+        }
+        if (curr->m_right != nullptr) {
+            stack.push_back(curr->m_right);
         }
-        return result;
     }
-    return result;
+    return true;
 }
 // returns a counter to calculate npl
 int CQueue::helpCalcNpl1(Node * curr) {
@@ -345,28 +1869,52 @@ int CQueue::helpCalcNpl1(Node * curr) {
 }
 // second helper for npl that traverses and checks the value are correct
 bool CQueue::helpCalcNpl2(Node * curr) {
-    if (curr == nullptr) {
-        return true;
+    vector<Node*> stack;
+    if (curr != nullptr) {
+        stack.push_back(curr);
     }
-    int value = helpCalcNpl1(curr); // call function into a value to store than check
-    if (value != curr->m_npl) {
-        return false;
+    while (!stack.empty()) {
+        curr = stack.back();
+        stack.pop_back();
+        int value = helpCalcNpl1(curr); // call function into a value to store than check
+        if (value != curr->m_npl) {
+            return false;
+        }
+        if (curr->m_left != nullptr) {
+            stack.push_back(curr->m_left);
+        }
+        if (curr->m_right != nullptr) {
+            stack.push_back(curr->m_right);
+        }
     }
-
-    return helpCalcNpl2(curr->m_left) && helpCalcNpl2(curr->m_right); // recursive goes through
+    return true;
 }
 // checks that the nodes have created a deep copy
 bool CQueue::helpDeepCopyCheck(Node * curr, Node * temp) {
-    if (curr == nullptr) {
-        return true;
-    }
-    // they can't equal each other or false
-    if(curr == temp) {
-        return false;
-    }
-    // checks that all their values aren't the same
-    if(curr->m_order.m_orderID != temp->m_order.m_orderID || curr->m_order.m_customerID != temp->m_order.m_customerID || curr->m_order.m_count != temp->m_order.m_count || curr->m_order.m_points != temp->m_order.m_points || curr->m_order.m_item != temp->m_order.m_item || curr->m_order.m_membership != temp->m_order.m_membership ){
-        return false;
+    vector<pair<Node*, Node*> > stack; // matching nodes of the two heaps
+    stack.push_back(make_pair(curr, temp));
+    while (!stack.empty()) {
+        curr = stack.back().first;
+        temp = stack.back().second;
+        stack.pop_back();
+        if (curr == nullptr || temp == nullptr) {
+            if (curr != temp) { // the shapes differ
+                return false;
+            }
+            continue;
+        }
+        // they can't equal each other or false
+        if(curr == temp) {
+            return false;
+        }
+        // checks that all their values aren't the same
+        Order first = OrderStore::get(curr->m_handle);
+        Order second = OrderStore::get(temp->m_handle);
+        if(curr->m_handle == temp->m_handle || first.m_orderID != second.m_orderID || first.m_customerID != second.m_customerID || first.m_count != second.m_count || first.m_points != second.m_points || first.m_item != second.m_item || first.m_membership != second.m_membership ){
+            return false;
+        }
+        stack.push_back(make_pair(curr->m_left, temp->m_left));
+        stack.push_back(make_pair(curr->m_right, temp->m_right));
     }
-    return helpDeepCopyCheck(curr->m_left, temp->m_left) && helpDeepCopyCheck(curr->m_right, temp->m_right);
+    return true;
 }
\ No newline at end of file
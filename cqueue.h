@@ -3,7 +3,18 @@
 #include <stdexcept>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <atomic>
+#include <climits>
+#include <span>
 using namespace std;
+// Compile with -DCQUEUE_STATS to collect operation counters and heap-shape
+// statistics; without it every CQUEUE_STAT() statement compiles to nothing.
+#ifdef CQUEUE_STATS
+#define CQUEUE_STAT(statement) statement
+#else
+#define CQUEUE_STAT(statement)
+#endif
 class Grader;   // forward declaration (for grading purposes)
 class Tester;   // forward declaration
 class CQueue;   // forward declaration
@@ -11,6 +22,7 @@ class Order;    // forward declaration
 #define EMPTY Order("",1,0)
 const int MINCUSTID = 100001;// minimum customer ID
 const int MAXCUSTID = 999999;// maximum customer ID
+const int NUMCUSTOMERS = MAXCUSTID - MINCUSTID + 1; // size of the per-customer arrays
 // use a different seed in the Random class to get different series of numbers
 const int MINORDERID = 100001;// minimum order ID
 const int MAXORDERID = 999999;// maximum order ID
@@ -19,11 +31,28 @@ enum ITEM {COFFEE, LATTE, SOFTDRINK, MILK, WATER, ICEDTEA};// use with MinHeap
 enum COUNT {ONE, PAIR, HALFDOZEN, DOZEN};// use with MaxHeap
 const int MINPOINTS = 0; // the points colleted so far, use with MaxHeap
 const int MAXPOINTS = 5000; // the points colleted so far, use with MaxHeap
+const int NUMITEMS = 6; // number of ITEM values
+const int NUMTIERS = 6; // number of MEMBERSHIP values, TIER1 .. TIER6
+const int NUMCOUNTS = 4;// number of COUNT values
+const int PARALLELREBUILD = 65536; // smallest queue rebuilt on the thread pool
+const long long AGINGSPAN = 1LL << 30; // largest linear aging offset, half the key range
+const int REKEYSTEP = 8; // stale nodes re-keyed by each insert, or pop with linear aging, during a re-key
+const int PRIORITYBLOCK = 1024; // orders whose priorities are computed in one batch call
+const int ORDERBLOCKBITS = 10;   // an OrderStore block holds 2^ORDERBLOCKBITS orders
+const int ORDERBLOCK = 1 << ORDERBLOCKBITS;
+const int ORDERPAGES = 1 << (32 - 2 * ORDERBLOCKBITS); // directory pages of ORDERBLOCK blocks each
+const unsigned int NOORDER = UINT_MAX; // end of the free slot chain of an OrderStore
+const int NODEBLOCKMIN = 16;     // nodes in the first block of a NodePool
+const int NODEBLOCKMAX = 65536;  // NodePool blocks double in size up to this
 
 enum HEAPTYPE {MINHEAP, MAXHEAP};
 enum STRUCTURE {SKEW, LEFTIST};
+// what insertOrder did with an order
+enum ADMISSION {ADMITTED, INVALIDID, CUSTOMERLIMIT, RATELIMITED};
 // Priority function pointer type
 typedef int (*prifn_t)(const Order&);
+// Aging curve type, the priority bonus after waiting a number of epochs
+typedef long long (*agefn_t)(long long waited);
 
 class Order{
     // stores a customer's order
@@ -31,6 +60,9 @@ public:
     friend class Grader; // for grading purposes
     friend class Tester; // for testing purposes
     friend class CQueue;
+    friend class PriorityTable;
+    friend class OrderBatch;
+    friend class OrderStore;
     Order(ITEM item = COFFEE, COUNT count = ONE,
           MEMBERSHIP membership = TIER5, int points = 0,
           int customerID = 0, int orderID = 0)
@@ -90,6 +122,18 @@ public:
         }
         return result;
     }
+    int getUnits() const { // how many drinks the order is for
+        int result = 1;
+        switch (m_count)
+        {
+            case ONE: result = 1; break;
+            case PAIR: result = 2; break;
+            case HALFDOZEN: result = 6; break;
+            case DOZEN: result = 12; break;
+            default: break;
+        }
+        return result;
+    }
     string getCountString() const {
         string result = "UNKNOWN";
         switch (m_count)
@@ -115,30 +159,263 @@ private:
     COUNT m_count;  // the count of ordered item
 
 };
+class OrderBatch{
+    // Orders stored column by column, so the priorities of many orders can
+    // be computed with vector loads. CQueue::bulkLoad takes one directly.
+public:
+    OrderBatch() {}
+    explicit OrderBatch(const vector<Order>& orders);
+    void addOrder(const Order& order);
+    Order getOrder(int index) const;
+    int size() const {return (int)m_orderIDs.size();}
+    void reserve(int orders);
+    void clear();
+
+private:
+    friend class PriorityTable;
+    friend class CQueue;
+    vector<int> m_items;
+    vector<int> m_counts;
+    vector<int> m_memberships;
+    vector<int> m_points;
+    vector<int> m_customerIDs;
+    vector<int> m_orderIDs;
+};
+class PriorityTable{
+    // A priority function compiled into lookup tables, evaluating it is two
+    // loads, a multiply and two adds with no branches:
+    // priority = itemTier[item][membership] + count[count] + pointsWeight * points
+    // Build one with PriorityModel::compile.
+public:
+    constexpr PriorityTable() : m_itemTier(), m_count(), m_pointsWeight(0) {}
+    int operator()(const Order& order) const {
+        return m_itemTier[order.m_item * NUMTIERS + order.m_membership] + m_count[order.m_count]
+               + m_pointsWeight * order.m_points;
+    }
+    constexpr bool operator==(const PriorityTable& rhs) const = default;
+    // Priorities of count orders given as columns, eight at a time with AVX2
+    // gathers when the CPU has them and one at a time otherwise
+    void evaluate(const int *items, const int *memberships, const int *counts, const int *points,
+                  int count, int *priorities) const;
+    // priorities of the orders first .. first + count - 1 of a batch
+    void evaluate(const OrderBatch& batch, int first, int count, int *priorities) const;
+
+private:
+    friend class PriorityModel;
+    int m_itemTier[NUMITEMS * NUMTIERS]; // item and membership folded into one table
+    int m_count[NUMCOUNTS];
+    int m_pointsWeight;
+};
+class PriorityModel{
+    // Declarative priority: every enum field is mapped through a value table,
+    // by default the enum's own number, and multiplied by the field's weight,
+    // points are multiplied by their weight, and the terms are added up.
+    // Everything is constexpr, so a model can be compiled at compile time:
+    //   constexpr PriorityTable table = PriorityModel().setCountWeight(1).setPointsWeight(1).compile();
+public:
+    constexpr PriorityModel() : m_itemValues(), m_tierValues(), m_countValues(), m_itemWeight(0),
+                                m_tierWeight(0), m_countWeight(0), m_pointsWeight(0) {
+        for (int i = 0; i < NUMITEMS; i++) {
+            m_itemValues[i] = i;
+        }
+        for (int i = 0; i < NUMTIERS; i++) {
+            m_tierValues[i] = i;
+        }
+        for (int i = 0; i < NUMCOUNTS; i++) {
+            m_countValues[i] = i;
+        }
+    }
+    constexpr PriorityModel& setItemWeight(int weight) {m_itemWeight = weight; return *this;}
+    constexpr PriorityModel& setTierWeight(int weight) {m_tierWeight = weight; return *this;}
+    constexpr PriorityModel& setCountWeight(int weight) {m_countWeight = weight; return *this;}
+    constexpr PriorityModel& setPointsWeight(int weight) {m_pointsWeight = weight; return *this;}
+    constexpr PriorityModel& setItemValue(ITEM item, int value) {m_itemValues[item] = value; return *this;}
+    constexpr PriorityModel& setTierValue(MEMBERSHIP tier, int value) {m_tierValues[tier] = value; return *this;}
+    constexpr PriorityModel& setCountValue(COUNT count, int value) {m_countValues[count] = value; return *this;}
+    constexpr PriorityTable compile() const {
+        PriorityTable table;
+        for (int i = 0; i < NUMITEMS; i++) {
+            for (int t = 0; t < NUMTIERS; t++) {
+                table.m_itemTier[i * NUMTIERS + t] = m_itemWeight * m_itemValues[i] + m_tierWeight * m_tierValues[t];
+            }
+        }
+        for (int c = 0; c < NUMCOUNTS; c++) {
+            table.m_count[c] = m_countWeight * m_countValues[c];
+        }
+        table.m_pointsWeight = m_pointsWeight;
+        return table;
+    }
+
+private:
+    int m_itemValues[NUMITEMS];
+    int m_tierValues[NUMTIERS];
+    int m_countValues[NUMCOUNTS];
+    int m_itemWeight;
+    int m_tierWeight;
+    int m_countWeight;
+    int m_pointsWeight;
+};
+class OrderStore{
+    // The orders of a queue, kept column by column in blocks of ORDERBLOCK
+    // orders, so a heap node only carries a 32 bit handle and melds walk
+    // keys and links instead of whole orders. A handle is the number of its
+    // block in a directory shared by all stores plus the slot in the block,
+    // so an order is read from its handle alone and merging two stores moves
+    // the blocks without touching the handles. Each block chains its free
+    // slots through their handles, and the store lists the blocks that have
+    // free slots. A block whose last order is removed goes back to the
+    // directory unless it is the only one with room left.
+public:
+    OrderStore();
+    ~OrderStore();
+    OrderStore(const OrderStore&) = delete;
+    OrderStore& operator=(const OrderStore&) = delete;
+    unsigned int add(const Order& order, long long epoch);
+    void remove(unsigned int handle);
+    void take(OrderStore& rhs);       // moves all the orders of rhs here, their handles stay valid
+    void copy(const OrderStore& rhs); // replaces the orders by copies of the ones of rhs
+    unsigned int copied(unsigned int handle) const; // handle of the copy of an order of the copied store
+    void clear();
+    int numBlocks() const {return (int)m_blocks.size();}
+    static Order get(unsigned int handle);
+    static int item(unsigned int handle) {return block(handle)->m_items[handle & (ORDERBLOCK - 1)];}
+    static int membership(unsigned int handle) {return block(handle)->m_memberships[handle & (ORDERBLOCK - 1)];}
+    static int count(unsigned int handle) {return block(handle)->m_counts[handle & (ORDERBLOCK - 1)];}
+    static int points(unsigned int handle) {return block(handle)->m_points[handle & (ORDERBLOCK - 1)];}
+    static int customerID(unsigned int handle) {return block(handle)->m_customerIDs[handle & (ORDERBLOCK - 1)];}
+    static long long epoch(unsigned int handle) {return block(handle)->m_epochs[handle & (ORDERBLOCK - 1)];}
+    static void prefetch(unsigned int handle); // the columns get() reads
+
+private:
+    struct Block{
+        unsigned char m_items[ORDERBLOCK];
+        unsigned char m_memberships[ORDERBLOCK];
+        unsigned char m_counts[ORDERBLOCK];
+        int m_points[ORDERBLOCK];
+        int m_customerIDs[ORDERBLOCK];
+        int m_orderIDs[ORDERBLOCK];
+        long long m_epochs[ORDERBLOCK];     // epoch the order was inserted in
+        unsigned int m_next[ORDERBLOCK];    // next free slot while the slot is free
+        unsigned int m_free;                // first free slot, NOORDER if the block is full
+        int m_used;                         // slots holding an order
+        int m_index;                        // position in the block list of its store
+        int m_openIndex;                    // position in the open list of its store, -1 if full
+    };
+    vector<unsigned int> m_blocks; // directory numbers of the blocks this store owns
+    vector<unsigned int> m_open;   // blocks with free slots, the last one is filled first
+    int m_freeSlots;               // in all the open blocks
+    static Block **m_pages[ORDERPAGES]; // the directory, allocated a page at a time
+
+    static Block *block(unsigned int handle) {
+        unsigned int number = handle >> ORDERBLOCKBITS;
+        return m_pages[number >> ORDERBLOCKBITS][number & (ORDERBLOCK - 1)];
+    }
+    void addBlock();               // a new empty block, at the end of the open list
+    void dropBlock(Block *b);      // an empty block goes back to the directory
+    static unsigned int allocateBlock();
+    static void releaseBlock(unsigned int number);
+};
 class Node{
     // this is a node in the skew/leftist heap
 public:
     friend class Grader; // for grading purposes
     friend class Tester; // for testing purposes
     friend class CQueue;
-    Node(Order order) {
-        m_order = order;
+    friend class NodePool;
+    Node(unsigned int handle) {
         m_right = nullptr;
         m_left = nullptr;
+        m_key = 0;
         m_npl = 0;
+        m_handle = handle;
+        m_itemRight = nullptr;
+        m_itemLeft = nullptr;
+        m_indexed = false;
+        m_taken = false;
     }
-    Order getOrder() const {return m_order;}
+    Order getOrder() const {return OrderStore::get(m_handle);}
     void setNPL(int npl) {m_npl = npl;}
     int getNPL() const {return m_npl;}
     // Overloaded insertion operator
     friend ostream& operator<<(ostream& sout, const Node& node);
 
 private:
-    Order m_order;    // order information
+    // the fields a meld reads come first
     Node * m_right;   // right child
     Node * m_left;    // left child
+    // what the heap is ordered by, smaller first: the priority including aging
+    // (negated for a MAXHEAP) in the high 32 bits, the insertion sequence in the low ones
+    unsigned long long m_key;
     int m_npl;        // null path length for leftist heap
+    unsigned int m_handle; // the order in the OrderStore of the queue
+    Node * m_itemRight;// right child in the per-item index
+    Node * m_itemLeft; // left child in the per-item index
+    bool m_indexed;    // linked into the per-item index
+    bool m_taken;      // already handed out, unlinked once it surfaces
+};
+class NodePool{
+    // The nodes of a queue, carved out of a few large blocks instead of
+    // being allocated one by one. Freed nodes are chained through m_left
+    // and reused first, the unused rest of the blocks is handed out in
+    // address order, so nodes allocated one after the other are adjacent.
+    // Merging two queues moves the blocks along with the nodes.
+public:
+    friend class Tester; // for testing purposes
+    NodePool();
+    ~NodePool();
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+    Node *allocate(unsigned int handle);
+    Node *allocateRun(int count); // count adjacent nodes, the caller constructs them
+    // A pool drained of its last node frees its blocks if they hold more
+    // than one full block, so a queue doesn't keep its peak footprint
+    void release(Node *node);
+    void take(NodePool& rhs);     // moves all the blocks of rhs here
+    // Forgets every node but keeps the blocks, adding one if count nodes
+    // would not fit. The next allocations walk the blocks in address order.
+    void reset(int count);
+    void clear();                 // frees the blocks
+    int live() const {return m_live;}
+    long long capacity() const {return m_capacity;}
+    // share of the nodes on the free list, the holes between live nodes
+    double fragmentation() const;
+
+private:
+    vector<pair<Node*, int> > m_blocks;    // start and size of each block
+    vector<pair<Node*, Node*> > m_regions; // unused [first, end) ranges, the last one is used first
+    Node *m_free;           // first freed node
+    Node *m_lastFree;       // end of the chain, so another chain can be appended
+    long long m_capacity;   // nodes in all blocks
+    int m_live;             // nodes handed out and not released
+    int m_holes;            // nodes on the free list
+
+    Node *addBlock(int count);
+};
+#ifdef CQUEUE_STATS
+class CQueueStats{
+    // counters collected by a CQueue, plus a snapshot of the heap shape
+public:
+    CQueueStats() {
+        m_inserts = 0; m_pops = 0; m_merges = 0; m_rebuilds = 0; m_compactions = 0;
+        m_priorityCalls = 0; m_melds = 0; m_meldSteps = 0; m_maxMeldDepth = 0;
+        m_size = 0; m_maxDepth = 0; m_liveBytes = 0;
+    }
+    unsigned long long m_inserts;       // orders accepted by insertOrder
+    unsigned long long m_pops;          // orders removed by getNextOrder
+    unsigned long long m_merges;        // successful mergeWithQueue calls
+    unsigned long long m_rebuilds;      // setPriorityFn/setStructure rebuilds
+    unsigned long long m_compactions;   // compact() calls, explicit or by maybeCompact()
+    unsigned long long m_priorityCalls; // priority function invocations
+    unsigned long long m_melds;         // top level helpMerge calls
+    unsigned long long m_meldSteps;     // helpMerge recursions over all melds
+    unsigned long long m_maxMeldDepth;  // longest right spine walked by one meld
+    // the following are filled in by CQueue::getStats()
+    int m_size;                         // orders in the queue
+    int m_maxDepth;                     // deepest node, root is depth 1
+    unsigned long long m_liveBytes;     // bytes held by live nodes
+    vector<unsigned long long> m_nplCounts; // LEFTIST only, nodes per npl value
 };
+#endif
 class CQueue{
     // stores the skew/leftist heap, minheap/maxheap
 public:
@@ -146,41 +423,209 @@ public:
     friend class Tester; // for testing purposes
 
     CQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure);
+    // a queue whose priorities come from a compiled table instead of a function
+    CQueue(const PriorityTable& table, HEAPTYPE heapType, STRUCTURE structure);
     ~CQueue();
     CQueue(const CQueue& rhs);
     CQueue& operator=(const CQueue& rhs);
-    void insertOrder(const Order& order);
+    // Take the orders and nodes of rhs without copying them, rhs is left
+    // empty with its configuration and admission limits
+    CQueue(CQueue&& rhs);
+    CQueue& operator=(CQueue&& rhs);
+    ADMISSION insertOrder(const Order& order);
     Order getNextOrder(); // Return the highest priority order
+    // Returns the highest priority order followed by the next orders for the
+    // same item, in priority order, as long as their units fit in maxUnits
+    vector<Order> getNextBatch(int maxUnits);
+    // priority of the highest priority order including aging, what the
+    // heap is ordered by, throws out_of_range when empty
+    long long getTopKey();
+    // Takes all orders of rhs, throws domain_error if rhs is empty. If the
+    // two queues differ in priority function, heap type, structure or aging,
+    // the orders of the smaller one are first rebuilt in linear time, without
+    // allocating, with the configuration of the larger one. This queue ends
+    // up with the configuration of the larger queue, rhs is left empty with
+    // its own.
     void mergeWithQueue(CQueue& rhs);
+    // Lazy merging: mergeWithQueue links the heaps of rhs into a pending
+    // list instead of melding them, the pending heaps are melded pairwise
+    // once the root is needed. Only the meld is put off, the rest of the
+    // merge is done right away: the blocks of rhs are handed over, a rhs
+    // of fewer than ORDERBLOCK/8 orders is copied, admission counts are
+    // added (walking rhs when it is small) and both item indexes are
+    // merged item by item. Off by default, turning it off melds what is
+    // pending.
+    void setLazyMerge(bool lazy);
+    bool getLazyMerge() const;
+    // Merges all the queues into a new one. Their orders and nodes are
+    // handed over once, then the heaps are melded in a balanced tournament,
+    // the melds of a round on the thread pool if parallel is set. Throws
+    // domain_error before anything is merged
+    // if a queue is configured unlike the first one, or is listed twice,
+    // and invalid_argument for a nullptr. The new queue gets the
+    // configuration and admission limits of the first queue, each customer
+    // keeps the fewest tokens any of the queues left it. All the queues
+    // are left empty.
+    static CQueue mergeAll(span<CQueue*> queues, bool parallel = false);
+    // Inserts several backlogs at once, one heap is built per backlog on the
+    // thread pool and the heaps are melded in a balanced tournament. A built
+    // item index is kept, the new orders are added to it.
+    void bulkLoad(const vector<vector<Order> >& backlogs);
+    // Same for orders stored by column, their priorities are computed in
+    // blocks straight from the columns, vectorized if the queue uses a table
+    void bulkLoad(const OrderBatch& batch);
     void clear();
     int numOrders() const; // Return number of orders in queue
     void printOrdersQueue() const; // Print the queue using preorder traversal
-    prifn_t getPriorityFn() const;
+    prifn_t getPriorityFn() const; // nullptr if the queue uses a table
     // Set a new priority function. Must rebuild the heap!!!
     void setPriorityFn(prifn_t priFn, HEAPTYPE heapType);
+    // Switches to a compiled table, rebuilds the heap like setPriorityFn
+    void setPriorityFn(const PriorityTable& table, HEAPTYPE heapType);
+    PriorityTable getPriorityTable() const;
     HEAPTYPE getHeapType() const;
     STRUCTURE getStructure() const;
     // Set a new data structure (skew/leftist). Must rebuild the heap!!!
     void setStructure(STRUCTURE structure);
+    // Linear aging, an order gains weight priority points per epoch it waits.
+    // Stored keys are offset by the insertion epoch, counted from a base
+    // epoch so they never go stale. The base moves every AGINGSPAN / weight
+    // epochs and the heap is re-keyed like a curve-aged one. Orders that
+    // waited longer than twice that tie and go first in first out.
+    // 0 turns aging off. Rebuilds the heap.
+    void setAging(int weight);
+    // Non-linear aging, the bonus is curve(epochs waited). Keys go stale, so
+    // the heap is re-keyed once rekeyInterval epochs have passed, a few nodes
+    // per insert, and all that are left by the first pop after that, since
+    // orders that waited longer may now overtake the ones moved already.
+    // nullptr turns aging off. Rebuilds the heap.
+    void setAgingCurve(agefn_t curve, int rekeyInterval);
+    int getAgingWeight() const;
+    agefn_t getAgingCurve() const;
+    void rekey(); // re-keys a curve-aged heap now, in one batch
+    // the epoch clock is shared by all queues so their keys can be merged
+    static void advanceEpoch(long long epochs = 1);
+    static long long currentEpoch();
+    // Per-customer admission control. A customer may have at most
+    // maxOutstanding orders in the queue and needs a token per order, with
+    // tokensPerEpoch tokens refilled per epoch up to burst. 0 turns a check
+    // off, all 0 turns admission off and frees the per-customer arrays.
+    void setAdmission(int maxOutstanding, int tokensPerEpoch, int burst);
+    int getOutstanding(int customerID) const; // orders of the customer in the queue
+    // Runs admission for an order that enters the queue later, it counts as
+    // outstanding until then. withdraw drops the count again before the order
+    // is bulk loaded, which counts it anew, or when it is not queued after all.
+    ADMISSION admit(const Order& order);
+    void withdraw(const Order& order);
+    // Moves all nodes into one block in the order melds and pops walk
+    // them: right spine after right spine, breadth first, so the top levels
+    // and every spine are adjacent. The shape of the heap does not change.
+    void compact();
+    // Sets the getFragmentation() at which maybeCompact() compacts, 0 turns
+    // it off. Pops never compact, the owner calls maybeCompact() when it can
+    // afford the O(n) pause, between bursts for example. maybeCompact() also
+    // shrinks a node pool of more than NODEBLOCKMAX nodes once less than a
+    // quarter of it is live, whatever the threshold.
+    void setCompaction(double threshold);
+    bool maybeCompact(); // returns whether it compacted
+    // share of the node pool that is freed and not reused yet, 0 right after compact()
+    double getFragmentation() const;
     void dump() const; // For debugging purposes
+#ifdef CQUEUE_STATS
+    CQueueStats getStats() const; // counters plus the current heap shape
+    // Writes the statistics in the Prometheus text format, returns false on I/O error
+    bool exportStats(const string& fileName, const string& name = "cqueue") const;
+#endif
 
 private:
     Node * m_heap;          // Pointer to the root of skew heap
+    // heaps merged lazily and not melded into m_heap yet, empty if m_heap is nullptr
+    vector<Node*> m_pending;
+    bool m_lazyMerge;       // mergeWithQueue puts the meld off, links into m_pending
+    // Nodes whose keys are for the epoch before m_rekeyEpoch, in a heap of
+    // their own. Each insert and pop moves a few into m_heap with fresh keys,
+    // the root first. A linear re-key shifts every stale key alike, so the
+    // stale root stays the best of them. A curve does not, so a pop re-keys
+    // the rest at once. nullptr if there are none, always when m_heap is.
+    Node * m_stale;
     int m_size;             // Current size of the heap
     prifn_t m_priorFunc;    // Function to compute priority
+    PriorityTable m_priorTable; // used instead when m_priorFunc is nullptr
     HEAPTYPE m_heapType;    // either a MINHEAP or a MAXHEAP
     STRUCTURE m_structure;  // skew heap or leftist heap
+    int m_agingWeight;      // linear aging, priority points per epoch
+    agefn_t m_agingCurve;   // non-linear aging, nullptr if not used
+    int m_rekeyInterval;    // epochs between re-keys of a curve-aged heap
+    long long m_rekeyEpoch; // epoch curve-aged keys were computed for, linear ones are offset from
+    unsigned int m_sequence;// insertion sequence of the next order, breaks ties first in first out
+    // Per-item skew heaps over the same nodes, built by the first
+    // getNextBatch. An order taken through one structure is marked taken and
+    // unlinked from the other lazily, when it reaches the top there.
+    Node * m_items[NUMITEMS];
+    bool m_itemIndex;       // m_items is built and kept up to date
+    OrderStore m_store;     // the orders, the nodes hold handles into it
+    NodePool m_pool;        // where the nodes live
+    double m_compactThreshold; // fragmentation at which maybeCompact() compacts, 0 if off
+    // Admission state, dense arrays indexed by customerID - MINCUSTID so a
+    // check is two loads. Empty while admission is off.
+    vector<int> m_outstanding;       // orders of each customer in the queue
+    vector<int> m_tokens;            // token bucket of each customer
+    vector<long long> m_refillEpoch; // epoch each bucket was last refilled in
+    int m_maxOutstanding;   // 0 if there is no limit
+    int m_tokenRate;        // tokens per epoch, 0 if not rate limited
+    int m_tokenBurst;       // bucket size
+    static atomic<long long> m_epochClock;
+#ifdef CQUEUE_STATS
+    mutable CQueueStats m_stats; // operation counters
+#endif
 
     void dump(Node *pos) const; // helper function for dump
 
     /******************************************
      * Private function declarations go here! *
      ******************************************/
-    void helpClear(Node*);
-    Node * helpCopy(Node*);
-    void helpPrintOrders(Node*, const Order& order) const;
+    void helpFree(Node*);
+    void helpMoveOrders(CQueue&);
+    Node * helpPopRoot();
+    void helpRelease(Node *);
+    Node * helpItemMerge(Node *, Node *);
+    void helpPurgeItem(int item);
+    void helpBuildItemIndex();
+    void helpIndexRun(Node *run, int count);
+    void helpIndexNodes(vector<Node*> items[NUMITEMS]);
+    void helpDropItemIndex();
+    void helpForgetItemIndex();
+    ADMISSION helpAdmit(const Order&);
+    void helpCountOrders(Node *, vector<int>&, int delta);
+    void helpForgetOrders();
+    Node * helpCopy(Node*, int& taken); // counts the taken nodes it copied
+    void helpPrintOrders(Node*) const;
     Node * helpMerge(Node*, Node*);
-    void helpRebuild(Node *);
+    Node * helpMeld(Node*, Node*);
+    int helpPriority(const Order&) const;
+    Node * helpRebuild(Node *, bool rekey);
+    void helpDetach(Node *, vector<Node*>&);
+    unsigned long long helpKey(const Order&, long long epoch, unsigned int sequence) const;
+    unsigned long long helpPackKey(long long priority, long long epoch, unsigned int sequence) const;
+    void helpPriorities(const OrderBatch&, int first, int count, int *priorities) const;
+    unsigned int helpSequence(unsigned int count);
+    void helpRenumber();
+    void helpRekey(Node **, int);
+    void helpCheckRekey();
+    long long helpAgingBase(long long epoch) const;
+    void helpMigrate(int count);
+    void helpFinishRekey();
+    void helpConsolidate();
+    bool helpMergeable(const CQueue&) const;
+    void helpConvert(const CQueue&);
+    void helpSetConfig(const CQueue&);
+    void helpTake(CQueue&); // the moves, this queue is empty
+    void helpDropTaken();
+    CQueue helpWorker() const;
+    Node * helpHeapify(Node **, int);
+    Node * helpParallelHeapify(vector<Node*>&, bool rekey);
+    Node * helpParallelMeld(vector<Node*>&, vector<CQueue>&);
+    void helpAddStats(vector<CQueue>&);
     bool helpHeapProperty(Node *);
     bool helpCheckLeftProperty(Node *);
     int helpCalcNpl1(Node *);
@@ -1,5 +1,19 @@
 #include "cqueue.h"
+#include "cqmetrics.h"
+#include "threadpool.h"
+#include "blockingcqueue.h"
+#include "asynccqueue.h"
+#include "boundedcqueue.h"
+#include "tierscheduler.h"
+#include "partitionedcqueue.h"
+#include "timingwheel.h"
+#include "persistentcqueue.h"
+#include <algorithm>
+#include <climits>
 #include <random>
+#include <fstream>
+#include <cstdio>
+#include <sstream>
 int priorityFn1(const Order &order);// works with a MAXHEAP
 int priorityFn2(const Order &order);// works with a MINHEAP
 
@@ -102,6 +116,37 @@ public:
     bool testDequeueException();
     bool testMergeException();
 
+#ifdef CQUEUE_STATS
+    bool testStatsCounters();
+#endif
+#ifdef CQUEUE_LATENCY
+    bool testLatencyHistogram();
+#endif
+#ifdef CQUEUE_TRACE
+    bool testTraceRecorder();
+#endif
+    bool testParallelRebuild();
+    bool testBulkLoad();
+    bool testBlockingQueue();
+    bool testAsyncDispatch();
+    bool testBoundedEviction();
+    bool testTierFairDequeue();
+    bool testPriorityAging();
+    bool testItemBatch();
+    bool testPartitionedStations();
+    bool testAdmissionControl();
+    bool testTimingWheel();
+    bool testFifoTies();
+    bool testPriorityTable();
+    bool testOrderBatch();
+    bool testOrderStore();
+    bool testDegenerateSkew();
+    bool testPersistentSnapshot();
+    bool testCompact();
+    bool testLazyMerge();
+    bool testMergeAll();
+    bool testCrossMerge();
+    bool testIncrementalRekey();
 };
 
 int main(){
@@ -217,6 +262,137 @@ int main(){
     else
         cout << "\ttestMergeException() returned false." << endl;
 
+#ifdef CQUEUE_STATS
+    if (tester.testStatsCounters()) // should return true
+        cout << "\ttestStatsCounters() returned true." << endl;
+    else
+        cout << "\ttestStatsCounters() returned false." << endl;
+
+#endif
+#ifdef CQUEUE_LATENCY
+    if (tester.testLatencyHistogram()) // should return true
+        cout << "\ttestLatencyHistogram() returned true." << endl;
+    else
+        cout << "\ttestLatencyHistogram() returned false." << endl;
+
+#endif
+#ifdef CQUEUE_TRACE
+    if (tester.testTraceRecorder()) // should return true
+        cout << "\ttestTraceRecorder() returned true." << endl;
+    else
+        cout << "\ttestTraceRecorder() returned false." << endl;
+
+#endif
+    if (tester.testParallelRebuild()) // should return true
+        cout << "\ttestParallelRebuild() returned true." << endl;
+    else
+        cout << "\ttestParallelRebuild() returned false." << endl;
+
+    if (tester.testBulkLoad()) // should return true
+        cout << "\ttestBulkLoad() returned true." << endl;
+    else
+        cout << "\ttestBulkLoad() returned false." << endl;
+
+    if (tester.testBlockingQueue()) // should return true
+        cout << "\ttestBlockingQueue() returned true." << endl;
+    else
+        cout << "\ttestBlockingQueue() returned false." << endl;
+
+    if (tester.testAsyncDispatch()) // should return true
+        cout << "\ttestAsyncDispatch() returned true." << endl;
+    else
+        cout << "\ttestAsyncDispatch() returned false." << endl;
+
+    if (tester.testBoundedEviction()) // should return true
+        cout << "\ttestBoundedEviction() returned true." << endl;
+    else
+        cout << "\ttestBoundedEviction() returned false." << endl;
+
+    if (tester.testTierFairDequeue()) // should return true
+        cout << "\ttestTierFairDequeue() returned true." << endl;
+    else
+        cout << "\ttestTierFairDequeue() returned false." << endl;
+
+    if (tester.testPriorityAging()) // should return true
+        cout << "\ttestPriorityAging() returned true." << endl;
+    else
+        cout << "\ttestPriorityAging() returned false." << endl;
+
+    if (tester.testItemBatch()) // should return true
+        cout << "\ttestItemBatch() returned true." << endl;
+    else
+        cout << "\ttestItemBatch() returned false." << endl;
+
+    if (tester.testPartitionedStations()) // should return true
+        cout << "\ttestPartitionedStations() returned true." << endl;
+    else
+        cout << "\ttestPartitionedStations() returned false." << endl;
+
+    if (tester.testAdmissionControl()) // should return true
+        cout << "\ttestAdmissionControl() returned true." << endl;
+    else
+        cout << "\ttestAdmissionControl() returned false." << endl;
+
+    if (tester.testTimingWheel()) // should return true
+        cout << "\ttestTimingWheel() returned true." << endl;
+    else
+        cout << "\ttestTimingWheel() returned false." << endl;
+
+    if (tester.testFifoTies()) // should return true
+        cout << "\ttestFifoTies() returned true." << endl;
+    else
+        cout << "\ttestFifoTies() returned false." << endl;
+
+    if (tester.testPriorityTable()) // should return true
+        cout << "\ttestPriorityTable() returned true." << endl;
+    else
+        cout << "\ttestPriorityTable() returned false." << endl;
+
+    if (tester.testOrderBatch()) // should return true
+        cout << "\ttestOrderBatch() returned true." << endl;
+    else
+        cout << "\ttestOrderBatch() returned false." << endl;
+
+    if (tester.testOrderStore()) // should return true
+        cout << "\ttestOrderStore() returned true." << endl;
+    else
+        cout << "\ttestOrderStore() returned false." << endl;
+
+    if (tester.testDegenerateSkew()) // should return true
+        cout << "\ttestDegenerateSkew() returned true." << endl;
+    else
+        cout << "\ttestDegenerateSkew() returned false." << endl;
+
+    if (tester.testPersistentSnapshot()) // should return true
+        cout << "\ttestPersistentSnapshot() returned true." << endl;
+    else
+        cout << "\ttestPersistentSnapshot() returned false." << endl;
+
+    if (tester.testCompact()) // should return true
+        cout << "\ttestCompact() returned true." << endl;
+    else
+        cout << "\ttestCompact() returned false." << endl;
+
+    if (tester.testLazyMerge()) // should return true
+        cout << "\ttestLazyMerge() returned true." << endl;
+    else
+        cout << "\ttestLazyMerge() returned false." << endl;
+
+    if (tester.testMergeAll()) // should return true
+        cout << "\ttestMergeAll() returned true." << endl;
+    else
+        cout << "\ttestMergeAll() returned false." << endl;
+
+    if (tester.testCrossMerge()) // should return true
+        cout << "\ttestCrossMerge() returned true." << endl;
+    else
+        cout << "\ttestCrossMerge() returned false." << endl;
+
+    if (tester.testIncrementalRekey()) // should return true
+        cout << "\ttestIncrementalRekey() returned true." << endl;
+    else
+        cout << "\ttestIncrementalRekey() returned false." << endl;
+
     Random orderIdGen(MINORDERID,MAXORDERID);
     Random customerIdGen(MINCUSTID,MAXCUSTID);
     customerIdGen.setSeed(0);
@@ -985,7 +1161,8 @@ bool Tester::testDequeueException() {
     return result;
 }
 //Function: Tester::testMergeException
-//Case: test merging with different priorities and heap type, should throw a error so it should be try than caught
+//Case: test merging with different priorities and heap type, the smaller queue is converted, then merging
+//the empty queue again should throw a error so it should be try than caught
 //Expected result: we expect this to return true as it should past the test case
 bool Tester::testMergeException() {
     bool result = false;
@@ -1008,16 +1185,1830 @@ bool Tester::testMergeException() {
                       i);
         aQueue.insertOrder(anOrder);
     }
+    aQueue2.mergeWithQueue(aQueue); // the empty aQueue2 takes the configuration of aQueue
+    bool converted = aQueue2.numOrders() == 300 && aQueue2.getPriorityFn() == priorityFn2
+                     && aQueue2.getHeapType() == MINHEAP && aQueue2.getStructure() == SKEW;
     try { // try to merge
         aQueue2.mergeWithQueue(aQueue);
     }
     catch(domain_error const&) { // catch domain error
-        result = true; // change result to true
+        result = converted; // change result to true
+    }
+
+    return result;
+}
+#ifdef CQUEUE_STATS
+//Function: Tester::testStatsCounters
+//Case: Insert 300 nodes, remove 10 and rebuild, test the counters, the shape statistics and the exported file
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testStatsCounters() {
+    bool result = true;
+
+    Random orderIdGen(MINORDERID,MAXORDERID);
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    CQueue aQueue(priorityFn2, MINHEAP, LEFTIST);
+    for (int i=100002;i<100302;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      i);
+        aQueue.insertOrder(anOrder);
+    }
+    for (int i=0;i<10;i++){
+        aQueue.getNextOrder();
+    }
+    CQueueStats stats = aQueue.getStats();
+    result = result && (stats.m_inserts == 300); // checks the counters
+    result = result && (stats.m_pops == 10);
+    result = result && (stats.m_melds == 310);
+    result = result && (stats.m_priorityCalls > 0);
+    result = result && (stats.m_size == 290);
+    result = result && (stats.m_liveBytes == 290 * sizeof(Node));
+
+    unsigned long long nodes = 0; // every node is counted once in the npl distribution
+    for (unsigned int i=0;i<stats.m_nplCounts.size();i++){
+        nodes += stats.m_nplCounts[i];
+    }
+    result = result && (nodes == 290);
+
+    aQueue.setStructure(SKEW); // a skew heap reports its depth but no npl values
+    stats = aQueue.getStats();
+    result = result && (stats.m_rebuilds == 1);
+    result = result && (stats.m_nplCounts.empty());
+    result = result && (stats.m_maxDepth > 0 && stats.m_maxDepth <= 290);
+
+    result = result && aQueue.exportStats("test_stats.prom", "test"); // checks the exported text
+    ifstream in("test_stats.prom");
+    string line;
+    bool found = false;
+    while (getline(in, line)) {
+        if (line == "cqueue_orders{queue=\"test\",structure=\"skew\",heap=\"min\"} 290") {
+            found = true;
+        }
+    }
+    in.close();
+    remove("test_stats.prom");
+    result = result && found;
+
+    result = result && aQueue.exportStats("test_stats.prom", "a\"b\\c\nd"); // the label is escaped
+    ifstream escapedIn("test_stats.prom");
+    found = false;
+    while (getline(escapedIn, line)) {
+        if (line == "cqueue_orders{queue=\"a\\\"b\\\\c\\nd\",structure=\"skew\",heap=\"min\"} 290") {
+            found = true;
+        }
+    }
+    escapedIn.close();
+    remove("test_stats.prom");
+    result = result && found && escapeQuoted("x\ty", true) == "x\\u0009y";
+
+    return result;
+}
+#endif
+#ifdef CQUEUE_LATENCY
+//Function: Tester::testLatencyHistogram
+//Case: Record known values into a histogram and time 300 inserts and 10 removals on a leftist heap
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testLatencyHistogram() {
+    bool result = true;
+
+    LatencyHistogram histogram;
+    for (unsigned long long i=1;i<=1000;i++){
+        histogram.record(i);
+        // the bucket of a value holds it and is at most 12.5% wider
+        unsigned long long top = LatencyHistogram::bucketTop(LatencyHistogram::bucketOf(i));
+        result = result && (top >= i && top <= i + i / 8);
+    }
+    result = result && (histogram.count() == 1000);
+    result = result && (histogram.max() == 1000);
+    result = result && (histogram.percentile(0.5) >= 500 && histogram.percentile(0.5) <= 500 + 500 / 8);
+    result = result && (histogram.percentile(0.99) >= 990 && histogram.percentile(0.99) <= 1000);
+    result = result && (histogram.percentile(1.0) == 1000);
+
+    Random orderIdGen(MINORDERID,MAXORDERID);
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    LatencyRecorder::reset();
+    CQueue aQueue(priorityFn2, MINHEAP, LEFTIST);
+    for (int i=100002;i<100302;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      i);
+        aQueue.insertOrder(anOrder);
+    }
+    for (int i=0;i<10;i++){
+        aQueue.getNextOrder();
+    }
+    LatencySummary inserts = LatencyRecorder::summary(LEFTIST, INSERTORDER);
+    LatencySummary pops = LatencyRecorder::summary(LEFTIST, NEXTORDER);
+    result = result && (inserts.m_count == 300); // every operation is timed once
+    result = result && (pops.m_count == 10);
+    result = result && (inserts.m_p50 <= inserts.m_p99 && inserts.m_p99 <= inserts.m_p999);
+    result = result && (inserts.m_p999 <= inserts.m_max);
+    result = result && (LatencyRecorder::summary(SKEW, INSERTORDER).m_count == 0);
+
+    return result;
+}
+#endif
+#ifdef CQUEUE_TRACE
+//Function: Tester::testTraceRecorder
+//Case: Trace 20 inserts and 5 removals, dump them as Chrome trace JSON and count the events
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testTraceRecorder() {
+    bool result = true;
+
+    Random orderIdGen(MINORDERID,MAXORDERID);
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    CQueue aQueue(priorityFn1, MAXHEAP, SKEW);
+    TraceRecorder::clear();
+    TraceRecorder::enable(true);
+    for (int i=100002;i<100022;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      i);
+        aQueue.insertOrder(anOrder);
+    }
+    Order order;
+    for (int i=0;i<5;i++){
+        order = aQueue.getNextOrder();
+    }
+    TraceRecorder::enable(false);
+    aQueue.getNextOrder(); // not traced anymore
+
+    stringstream trace;
+    TraceRecorder::dumpChromeTrace(trace);
+    string text = trace.str();
+    int inserts = 0; // counts the events of each kind
+    int pops = 0;
+    for (size_t pos = text.find("\"name\":"); pos != string::npos; pos = text.find("\"name\":", pos + 1)){
+        if (text.compare(pos, 20, "\"name\":\"insertOrder\"") == 0)
+            inserts++;
+        if (text.compare(pos, 21, "\"name\":\"getNextOrder\"") == 0)
+            pops++;
+    }
+    result = result && (inserts == 20);
+    result = result && (pops == 5);
+    // the last traced removal reports its order and the size left behind
+    string last = "\"args\":{\"size\":15,\"orderID\":" + to_string(order.getOrderID()) + "}";
+    result = result && (text.find(last) != string::npos);
+    result = result && (text.compare(0, 15, "{\"traceEvents\":") == 0);
+
+    return result;
+}
+#endif
+//Function: Tester::testParallelRebuild
+//Case: Insert 100000 nodes and rebuild them on a pool of 4 threads, changing priority and then structure
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testParallelRebuild() {
+    bool result = true;
+
+    Random orderIdGen(MINORDERID,MAXORDERID);
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    CQueue aQueue(priorityFn2, MINHEAP, SKEW);
+    for (int i=0;i<100000;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      orderIdGen.getRandNum());
+        aQueue.insertOrder(anOrder);
+    }
+    ThreadPool::shared().resize(3); // the caller is the fourth thread
+
+    aQueue.setPriorityFn(priorityFn1, MAXHEAP); // rebuilds on the pool
+    result = result && (aQueue.m_size == 100000);
+    result = result && aQueue.helpHeapProperty(aQueue.m_heap);
+
+    aQueue.setStructure(LEFTIST); // rebuilds on the pool
+    result = result && (aQueue.m_size == 100000);
+    result = result && aQueue.helpHeapProperty(aQueue.m_heap);
+    result = result && aQueue.helpCalcNpl2(aQueue.m_heap);
+    result = result && aQueue.helpCheckLeftProperty(aQueue.m_heap);
+
+    // all nodes are still there and come out in order
+    Order prev = aQueue.getNextOrder();
+    for (int i=1;i<100000;i++){
+        Order order = aQueue.getNextOrder();
+        result = result && (priorityFn1(prev) >= priorityFn1(order));
+        prev = order;
+    }
+    result = result && (aQueue.m_heap == nullptr);
+
+    ThreadPool::shared().resize(thread::hardware_concurrency() > 1 ? thread::hardware_concurrency() - 1 : 0);
+
+    return result;
+}
+//Function: Tester::testBulkLoad
+//Case: Bulk load 4 backlogs of 500 orders, 20 of them with invalid IDs, into a leftist heap holding 100 orders
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testBulkLoad() {
+    bool result = true;
+
+    Random orderIdGen(MINORDERID,MAXORDERID);
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    CQueue aQueue(priorityFn1, MAXHEAP, LEFTIST);
+    for (int i=0;i<100;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      orderIdGen.getRandNum());
+        aQueue.insertOrder(anOrder);
     }
+    vector<vector<Order> > backlogs(4);
+    for (int b=0;b<4;b++){
+        for (int i=0;i<500;i++){
+            Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                          static_cast<COUNT>(countGen.getRandNum()),
+                          static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                          pointsGen.getRandNum(),
+                          customerIdGen.getRandNum(),
+                          (i % 100 == 0) ? 0 : orderIdGen.getRandNum()); // every 100th order is invalid
+            backlogs[b].push_back(anOrder);
+        }
+    }
+    ThreadPool::shared().resize(3); // the caller is the fourth thread
+    aQueue.bulkLoad(backlogs);
+    ThreadPool::shared().resize(thread::hardware_concurrency() > 1 ? thread::hardware_concurrency() - 1 : 0);
+
+    result = result && (aQueue.m_size == 100 + 4 * 495); // the invalid orders are skipped
+    result = result && aQueue.helpHeapProperty(aQueue.m_heap);
+    result = result && aQueue.helpCalcNpl2(aQueue.m_heap);
+    result = result && aQueue.helpCheckLeftProperty(aQueue.m_heap);
+    Order prev = aQueue.getNextOrder(); // everything comes out in order
+    int removed = 1;
+    while (aQueue.numOrders() > 0){
+        Order order = aQueue.getNextOrder();
+        result = result && (priorityFn1(prev) >= priorityFn1(order));
+        prev = order;
+        removed++;
+    }
+    result = result && (removed == 2080);
 
     return result;
 }
+//Function: Tester::testBlockingQueue
+//Case: 3 consumer threads wait for orders while a producer inserts 600 orders one by one and in batches, then a timed pop runs on the empty queue
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testBlockingQueue() {
+    bool result = true;
+
+    Random orderIdGen(MINORDERID,MAXORDERID);
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    vector<Order> orders;
+    for (int i=100002;i<100602;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      i);
+        orders.push_back(anOrder);
+    }
+    BlockingCQueue aQueue(priorityFn2, MINHEAP, SKEW);
+    vector<int> taken(3, 0);
+    vector<long long> idSums(3, 0);
+    vector<thread> consumers;
+    for (int c=0;c<3;c++){
+        consumers.push_back(thread([&aQueue, &taken, &idSums, c]() {
+            for (int i=0;i<200;i++){ // each station takes 200 orders
+                Order order = aQueue.waitNextOrder();
+                taken[c]++;
+                idSums[c] += order.getOrderID();
+            }
+        }));
+    }
+    for (int i=0;i<300;i++){ // half one by one, half in batches of 50
+        aQueue.insertOrder(orders[i]);
+    }
+    for (int i=300;i<600;i+=50){
+        aQueue.insertOrders(vector<Order>(orders.begin() + i, orders.begin() + i + 50));
+    }
+    for (int c=0;c<3;c++){
+        consumers[c].join();
+    }
+    long long expected = 0; // every order was taken exactly once
+    for (int i=0;i<600;i++){
+        expected += orders[i].getOrderID();
+    }
+    result = result && (taken[0] + taken[1] + taken[2] == 600);
+    result = result && (idSums[0] + idSums[1] + idSums[2] == expected);
+    result = result && (aQueue.numOrders() == 0);
+
+    Order order;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    result = result && !aQueue.tryGetNextOrder(order, chrono::milliseconds(20)); // times out
+    result = result && (chrono::steady_clock::now() - start >= chrono::milliseconds(20));
+    aQueue.insertOrder(orders[0]);
+    result = result && aQueue.tryGetNextOrder(order, chrono::milliseconds(20));
+    result = result && (order.getOrderID() == orders[0].getOrderID());
 
+    return result;
+}
+// a simulated barista station, takes a number of orders off the queue
+DispatchTask stationTask(AsyncCQueue& queue, int orders, vector<Order>& served) {
+    for (int i=0;i<orders;i++){
+        Order order = co_await queue.nextOrder();
+        served.push_back(order);
+    }
+}
+// a register that keeps inserting, waits whenever the queue is at capacity
+DispatchTask registerTask(AsyncCQueue& queue, const vector<Order>& orders, int& maxOrders) {
+    for (unsigned int i=0;i<orders.size();i++){
+        co_await queue.insert(orders[i]);
+        if (queue.numOrders() > maxOrders)
+            maxOrders = queue.numOrders();
+    }
+}
+// a register inserting one order, keeps what the queue said about it
+DispatchTask admissionTask(AsyncCQueue& queue, Order order, ADMISSION& status) {
+    status = co_await queue.insert(order);
+}
+//Function: Tester::testAsyncDispatch
+//Case: 5 station coroutines take 20 orders each from a queue bounded to 8 orders while a register coroutine inserts 100,
+//then two registers wait on a full queue, the first with an order whose customer ID is invalid
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testAsyncDispatch() {
+    bool result = true;
 
+    Random orderIdGen(MINORDERID,MAXORDERID);
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    vector<Order> orders;
+    for (int i=100002;i<100102;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      i);
+        orders.push_back(anOrder);
+    }
+    OrderExecutor executor;
+    AsyncCQueue aQueue(executor, priorityFn2, MINHEAP, LEFTIST, 8);
+    vector<vector<Order> > served(5);
+    for (int s=0;s<5;s++){ // the stations start first and have to wait
+        executor.spawn(stationTask(aQueue, 20, served[s]));
+    }
+    int maxOrders = 0;
+    executor.spawn(registerTask(aQueue, orders, maxOrders));
+    executor.run();
+
+    result = result && (executor.tasks() == 0); // every coroutine finished
+    result = result && (aQueue.numOrders() == 0);
+    result = result && (maxOrders <= 8); // the register was held back
+    long long expected = 0;
+    long long idSum = 0;
+    for (int i=0;i<100;i++){
+        expected += orders[i].getOrderID();
+    }
+    for (int s=0;s<5;s++){
+        result = result && (served[s].size() == 20);
+        for (unsigned int i=0;i<served[s].size();i++){
+            idSum += served[s][i].getOrderID();
+        }
+    }
+    result = result && (idSum == expected); // each order was served once
+
+    OrderExecutor idle; // a station left waiting is cleaned up with its executor
+    AsyncCQueue emptyQueue(idle, priorityFn2, MINHEAP, SKEW);
+    vector<Order> none;
+    idle.spawn(stationTask(emptyQueue, 1, none));
+    idle.run();
+    result = result && (idle.tasks() == 1);
+
+    // a producer that waited for room still learns its order was rejected
+    OrderExecutor single;
+    AsyncCQueue fullQueue(single, priorityFn2, MINHEAP, SKEW, 1);
+    result = result && fullQueue.tryInsert(orders[0]);
+    Order invalid(COFFEE, ONE, TIER1, 10, MINCUSTID - 1, 100200);
+    ADMISSION status = ADMITTED;
+    ADMISSION nextStatus = INVALIDID;
+    single.spawn(admissionTask(fullQueue, invalid, status));
+    single.spawn(admissionTask(fullQueue, orders[1], nextStatus)); // waits behind the invalid one
+    single.run(); // both wait, the queue is full
+    vector<Order> first;
+    single.spawn(stationTask(fullQueue, 2, first));
+    single.run(); // the room the rejected order left goes to the next producer
+    result = result && (status == INVALIDID) && (nextStatus == ADMITTED);
+    result = result && (fullQueue.numOrders() == 0) && (first.size() == 2) && (single.tasks() == 0);
+    result = result && !fullQueue.tryInsert(invalid);
 
+    return result;
+}
+//Function: Tester::testBoundedEviction
+//Case: Insert 300 nodes into queues capped at 50 orders, min and max heap, and test only the 50 best are kept,
+//then an order with an invalid customer ID
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testBoundedEviction() {
+    bool result = true;
 
+    Random orderIdGen(MINORDERID,MAXORDERID);
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    BoundedCQueue minQueue(priorityFn2, MINHEAP, 50);
+    BoundedCQueue maxQueue(priorityFn1, MAXHEAP, 50);
+    vector<int> minPriorities;
+    vector<int> maxPriorities;
+    int evictions = 0;
+    for (int i=100002;i<100302;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      i);
+        Order evicted;
+        bool hasEvicted = false;
+        result = result && (minQueue.insertOrder(anOrder, evicted, hasEvicted) == ADMITTED);
+        if (hasEvicted)
+            evictions++;
+        maxQueue.insertOrder(anOrder, evicted, hasEvicted);
+        minPriorities.push_back(priorityFn2(anOrder));
+        maxPriorities.push_back(priorityFn1(anOrder));
+    }
+    result = result && (evictions == 250);
+    result = result && (minQueue.numOrders() == 50 && maxQueue.numOrders() == 50);
+    Order evicted;
+    bool hasEvicted = true; // an invalid ID is refused on a full queue, nothing goes
+    result = result && (minQueue.insertOrder(Order(COFFEE, ONE, TIER1, 10, MINCUSTID - 1, 100400), evicted, hasEvicted) == INVALIDID);
+    result = result && !hasEvicted && (minQueue.numOrders() == 50);
+    sort(minPriorities.begin(), minPriorities.end());
+    sort(maxPriorities.rbegin(), maxPriorities.rend());
+    // the worst order kept is the 50th best of all the inserted orders
+    result = result && (priorityFn2(minQueue.getWorstOrder()) == minPriorities[49]);
+    result = result && (priorityFn1(maxQueue.getWorstOrder()) == maxPriorities[49]);
+    for (int i=0;i<50;i++){ // the rest comes out best first
+        result = result && (priorityFn2(minQueue.getNextOrder()) == minPriorities[i]);
+        result = result && (priorityFn1(maxQueue.getNextOrder()) == maxPriorities[i]);
+    }
+
+    // evicting from the bottom after a priority change
+    BoundedCQueue aQueue(priorityFn2, MINHEAP, 100);
+    for (int i=100002;i<100102;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      i);
+        Order evicted;
+        bool hasEvicted = false;
+        aQueue.insertOrder(anOrder, evicted, hasEvicted);
+    }
+    aQueue.setPriorityFn(priorityFn1, MAXHEAP);
+    Order prev = aQueue.evictWorstOrder();
+    for (int i=1;i<100;i++){
+        Order order = aQueue.evictWorstOrder();
+        result = result && (priorityFn1(prev) <= priorityFn1(order));
+        prev = order;
+    }
+    try { // the queue is empty now
+        aQueue.getWorstOrder();
+        result = false;
+    }
+    catch(out_of_range const&) {
+    }
+
+    return result;
+}
+//Function: Tester::testTierFairDequeue
+//Case: Insert 300 TIER1 and 300 TIER6 orders with weights 3 and 1, test the lower tier still gets a quarter of the dispatches,
+//then an order and a weight for a tier that does not exist
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testTierFairDequeue() {
+    bool result = true;
+
+    Random orderIdGen(MINORDERID,MAXORDERID);
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    TierScheduler scheduler(priorityFn2, MINHEAP, LEFTIST);
+    scheduler.setWeight(TIER1, 3);
+    for (int i=100002;i<100602;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      (i % 2 == 0) ? TIER1 : TIER6,
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      i);
+        scheduler.insertOrder(anOrder);
+    }
+    result = result && (scheduler.numOrders() == 600);
+    result = result && (scheduler.numOrders(TIER6) == 300);
+
+    int lastPriority[NUMTIERS] = {0, 0, 0, 0, 0, 0};
+    for (int i=0;i<400;i++){
+        Order order = scheduler.getNextOrder();
+        // inside a tier the orders still leave in priority order
+        result = result && (priorityFn2(order) >= lastPriority[order.getMemebership()]);
+        lastPriority[order.getMemebership()] = priorityFn2(order);
+    }
+    result = result && (scheduler.dispatched(TIER1) == 300); // 3:1 while both are busy
+    result = result && (scheduler.dispatched(TIER6) == 100);
+    result = result && (scheduler.numOrders() == 200);
+
+    while (scheduler.numOrders() > 0){ // TIER6 drains alone
+        scheduler.getNextOrder();
+    }
+    result = result && (scheduler.dispatched(TIER6) == 300);
+    try {
+        scheduler.getNextOrder();
+        result = false;
+    }
+    catch(out_of_range const&) {
+    }
+    // a membership past the last tier is rejected, not used as an index
+    Order badTier(COFFEE, ONE, static_cast<MEMBERSHIP>(NUMTIERS), 10, MINCUSTID, 100700);
+    result = result && (scheduler.insertOrder(badTier) == INVALIDID) && (scheduler.numOrders() == 0);
+    try {
+        scheduler.setWeight(static_cast<MEMBERSHIP>(-1), 2);
+        result = false;
+    }
+    catch(out_of_range const&) {
+    }
+
+    return result;
+}
+// quadratic aging curve for the tests
+long long squareAging(long long waited) {
+    return waited * waited;
+}
+//Function: Tester::testPriorityAging
+//Case: Insert 300 nodes over 30 epochs with linear aging, then millions of epochs later across a move of
+//the base epoch, then age orders with a quadratic curve
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testPriorityAging() {
+    bool result = true;
+
+    Random orderIdGen(MINORDERID,MAXORDERID);
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    CQueue aQueue(priorityFn2, MINHEAP, LEFTIST);
+    aQueue.setAging(1); // one point per epoch
+    long long start = CQueue::currentEpoch();
+    vector<long long> epochs(300);
+    for (int i=0;i<300;i++){
+        if (i % 10 == 0)
+            CQueue::advanceEpoch();
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      100002 + i);
+        epochs[i] = CQueue::currentEpoch();
+        aQueue.insertOrder(anOrder);
+    }
+    result = result && aQueue.helpCalcNpl2(aQueue.m_heap);
+    // priority minus the time waited never goes down, old orders jump ahead
+    long long now = CQueue::currentEpoch();
+    long long prev = -1000000;
+    int prevPriority = 0;
+    bool aged = false;
+    for (int i=0;i<300;i++){
+        Order order = aQueue.getNextOrder();
+        long long waited = now - epochs[order.getOrderID() - 100002];
+        long long effective = priorityFn2(order) - waited;
+        result = result && (effective >= prev);
+        if (i > 0 && priorityFn2(order) < prevPriority) // a worse order went first
+            aged = true;
+        prev = effective;
+        prevPriority = priorityFn2(order);
+    }
+    result = result && aged;
+    result = result && (now - start == 30);
+
+    // far from epoch 0 the offsets count from a base epoch and don't saturate
+    CQueue late(priorityFn2, MINHEAP, SKEW);
+    late.setAging(1000);
+    CQueue::advanceEpoch(3000000);
+    late.insertOrder(Order(ICEDTEA, ONE, TIER6, 0, MINCUSTID, 100002)); // priority 10
+    late.insertOrder(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100003)); // priority 0
+    long long base = late.m_rekeyEpoch;
+    CQueue::advanceEpoch(600000);
+    late.insertOrder(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100004));
+    CQueue::advanceEpoch(600000); // the base moves, the older orders are re-keyed
+    late.insertOrder(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100005));
+    result = result && late.m_rekeyEpoch > base && late.m_stale == nullptr;
+    result = result && late.getNextOrder().getOrderID() == 100003;
+    result = result && late.getNextOrder().getOrderID() == 100002;
+    result = result && late.getNextOrder().getOrderID() == 100004;
+    result = result && late.getNextOrder().getOrderID() == 100005;
+
+    // a quadratic curve is only applied when the queue is re-keyed
+    CQueue curveQueue(priorityFn2, MINHEAP, SKEW);
+    curveQueue.setAgingCurve(squareAging, 5);
+    Order oldOrder(ICEDTEA, ONE, TIER6, 0, MINCUSTID, 100002); // priority 10
+    curveQueue.insertOrder(oldOrder);
+    CQueue::advanceEpoch(4);
+    Order newOrder(COFFEE, ONE, TIER1, 0, MINCUSTID, 100003); // priority 0
+    curveQueue.insertOrder(newOrder);
+    CQueue copy(curveQueue);
+    result = result && (copy.getNextOrder().getOrderID() == 100003); // no re-key yet
+    CQueue::advanceEpoch(1);
+    // re-keyed: the old order waited 5 epochs (bonus 25), the new one 1 (bonus 1)
+    result = result && (curveQueue.getNextOrder().getOrderID() == 100002);
+    result = result && (curveQueue.getNextOrder().getOrderID() == 100003);
+
+    CQueue plain(priorityFn2, MINHEAP, SKEW); // re-keyed with the aging of the larger queue
+    plain.insertOrder(oldOrder);
+    copy.insertOrder(newOrder);
+    copy.mergeWithQueue(plain);
+    result = result && copy.numOrders() == 3 && copy.getAgingCurve() == squareAging && plain.numOrders() == 0;
+    result = result && (copy.getNextOrder().getOrderID() == 100002); // waited longest
+
+    return result;
+}
+//Function: Tester::testItemBatch
+//Case: Batches of mixed items and counts interleaved with pops, inserts and a merge of indexed queues
+//Expected result: every batch starts with the best order and holds only its item in priority order within
+//the unit limit, every order comes out exactly once
+bool Tester::testItemBatch() {
+    bool result = true;
+    Random itemGen(0, 5);
+    itemGen.setSeed(0);
+    Random countGen(0, 3);
+    Random pointsGen(MINPOINTS, MAXPOINTS);
+    Random memGen(0, 5);
+    CQueue queue(priorityFn1, MAXHEAP, LEFTIST);
+    CQueue other(priorityFn1, MAXHEAP, LEFTIST);
+    vector<bool> seen(MAXORDERID + 1, false);
+    int total = 0;
+    for (int i = 0; i < 2000; i++) {
+        Order order(ITEM(itemGen.getRandNum()), COUNT(countGen.getRandNum()), MEMBERSHIP(memGen.getRandNum()),
+                    pointsGen.getRandNum(), MINCUSTID, i + MINORDERID);
+        (i % 4 == 0 ? other : queue).insertOrder(order);
+        total++;
+    }
+    total -= (int)other.getNextBatch(12).size(); // both indexes are built before the merge
+    int popped = 0;
+    bool merged = false;
+    while (queue.numOrders() > 0 && result) {
+        if (!merged && popped > 200) {
+            queue.mergeWithQueue(other);
+            merged = true;
+        }
+        if (popped % 7 == 3) { // a plain pop now and then
+            Order order = queue.getNextOrder();
+            result = result && !seen[order.getOrderID()];
+            seen[order.getOrderID()] = true;
+            popped++;
+            continue;
+        }
+        if (!merged && popped == 0) {
+            popped += (int)queue.getNextBatch(12).size(); // builds the index of queue
+            continue;
+        }
+        CQueue probe(queue);
+        int best = priorityFn1(probe.getNextOrder());
+        vector<Order> batch = queue.getNextBatch(12);
+        result = result && priorityFn1(batch[0]) == best;
+        int units = 0;
+        for (unsigned int j = 0; j < batch.size(); j++) {
+            result = result && batch[j].getItem() == batch[0].getItem();
+            result = result && (j == 0 || priorityFn1(batch[j]) <= priorityFn1(batch[j - 1]));
+            result = result && !seen[batch[j].getOrderID()];
+            seen[batch[j].getOrderID()] = true;
+            units += batch[j].getUnits();
+        }
+        result = result && (batch.size() == 1 || units <= 12);
+        popped += (int)batch.size();
+        if (popped % 5 == 0) { // new orders go into the live index
+            queue.insertOrder(Order(ITEM(itemGen.getRandNum()), COUNT(countGen.getRandNum()),
+                                    MEMBERSHIP(memGen.getRandNum()), pointsGen.getRandNum(), MINCUSTID, 2000 + popped + MINORDERID));
+            total++;
+        }
+    }
+    result = result && merged && popped == total;
+    try {
+        queue.getNextBatch(12);
+        result = false;
+    }
+    catch (out_of_range&) {
+    }
+    return result;
+}
+//Function: Tester::testPartitionedStations
+//Case: Two stations over a queue partitioned by item, each drains its own items and then steals,
+//then three stations drain a second queue concurrently
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testPartitionedStations() {
+    bool result = true;
+
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    vector<Order> orders;
+    for (int i=100002;i<100602;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      i);
+        orders.push_back(anOrder);
+    }
+    // station 0 owns coffee, softdrink and water, station 1 the rest
+    PartitionedCQueue aQueue(priorityFn1, MAXHEAP, LEFTIST, 2);
+    CQueue ownQueue(priorityFn1, MAXHEAP, LEFTIST); // expected order of station 0
+    CQueue restQueue(priorityFn1, MAXHEAP, LEFTIST);
+    for (int i=0;i<600;i++){
+        aQueue.insertOrder(orders[i]);
+        if (aQueue.getStation(orders[i].getItem()) == 0)
+            ownQueue.insertOrder(orders[i]);
+        else
+            restQueue.insertOrder(orders[i]);
+    }
+    result = result && aQueue.numOrders() == 600;
+    Order order;
+    while (ownQueue.numOrders() > 0){ // own items first, best first, ties in any order
+        Order expected = ownQueue.getNextOrder();
+        result = aQueue.getNextOrder(0, order) && result;
+        result = result && priorityFn1(order) == priorityFn1(expected);
+        result = result && aQueue.getStation(order.getItem()) == 0;
+    }
+    result = result && aQueue.stolen(0) == 0;
+    for (int i=0;i<10;i++){ // then it steals the best order of the other station
+        Order expected = restQueue.getNextOrder();
+        result = aQueue.getNextOrder(0, order) && result;
+        result = result && priorityFn1(order) == priorityFn1(expected);
+    }
+    result = result && aQueue.stolen(0) == 10;
+    while (restQueue.numOrders() > 0){
+        Order expected = restQueue.getNextOrder();
+        result = aQueue.getNextOrder(1, order) && result;
+        result = result && priorityFn1(order) == priorityFn1(expected);
+    }
+    result = result && aQueue.stolen(1) == 0;
+    result = result && !aQueue.getNextOrder(1, order) && aQueue.numOrders() == 0;
+
+    PartitionedCQueue bQueue(priorityFn2, MINHEAP, SKEW, 3);
+    long long idSum = 0;
+    for (int i=0;i<600;i++){
+        bQueue.insertOrder(orders[i]);
+        idSum += orders[i].getOrderID();
+    }
+    vector<long long> idSums(3, 0);
+    vector<thread> stations;
+    for (int s=0;s<3;s++){
+        stations.push_back(thread([&bQueue, &idSums, s]() {
+            Order taken;
+            while (bQueue.getNextOrder(s, taken))
+                idSums[s] += taken.getOrderID();
+        }));
+    }
+    for (int s=0;s<3;s++){
+        stations[s].join();
+    }
+    result = result && idSums[0] + idSums[1] + idSums[2] == idSum && bQueue.numOrders() == 0;
+
+    try{
+        aQueue.getNextOrder(2, order); // there is no third station
+        result = false;
+    }
+    catch(out_of_range const&){
+    }
+    return result;
+}
+//Function: Tester::testAdmissionControl
+//Case: One customer floods a queue with an outstanding limit of 3 and 2 tokens per epoch (burst 4),
+//orders leave through pops, batches, a merge and clear
+//Expected result: we expect this to return true as it should past the test case
+bool Tester::testAdmissionControl() {
+    bool result = true;
+
+    int flooder = MINCUSTID + 42;
+    int other = MAXCUSTID;
+    CQueue aQueue(priorityFn2, MINHEAP, LEFTIST);
+    aQueue.insertOrder(Order(COFFEE, ONE, TIER1, 10, flooder, 100002)); // counted when admission starts
+    aQueue.setAdmission(3, 2, 4);
+    result = result && aQueue.getOutstanding(flooder) == 1;
+    result = (aQueue.insertOrder(Order(LATTE, ONE, TIER2, 10, flooder, 100003)) == ADMITTED) && result;
+    result = (aQueue.insertOrder(Order(MILK, ONE, TIER3, 10, flooder, 100004)) == ADMITTED) && result;
+    result = (aQueue.insertOrder(Order(MILK, ONE, TIER3, 10, flooder, 100005)) == CUSTOMERLIMIT) && result;
+    result = (aQueue.insertOrder(Order(MILK, ONE, TIER3, 10, flooder - MINCUSTID, 100006)) == INVALIDID) && result;
+    result = (aQueue.insertOrder(Order(MILK, ONE, TIER3, 10, other, 100007)) == ADMITTED) && result;
+    result = result && aQueue.numOrders() == 4 && aQueue.getOutstanding(flooder) == 3;
+    result = (aQueue.getNextOrder().getOrderID() == 100002) && result; // the flooder gets a slot back
+    result = result && aQueue.getOutstanding(flooder) == 2;
+    result = (aQueue.insertOrder(Order(WATER, ONE, TIER4, 10, flooder, 100008)) == ADMITTED) && result;
+    vector<Order> batch = aQueue.getNextBatch(12); // latte alone
+    result = result && batch.size() == 1 && aQueue.getOutstanding(flooder) == 2;
+    batch = aQueue.getNextBatch(12); // both milks
+    result = result && batch.size() == 2 && aQueue.getOutstanding(flooder) == 1 && aQueue.getOutstanding(other) == 0;
+    // the bucket started with 4 tokens, this takes the last one
+    result = (aQueue.insertOrder(Order(COFFEE, ONE, TIER1, 10, flooder, 100009)) == ADMITTED) && result;
+    result = (aQueue.insertOrder(Order(COFFEE, ONE, TIER1, 10, flooder, 100016)) == RATELIMITED) && result;
+    CQueue::advanceEpoch(); // refills 2 tokens
+    result = (aQueue.insertOrder(Order(COFFEE, ONE, TIER1, 10, flooder, 100010)) == ADMITTED) && result;
+    result = result && aQueue.getOutstanding(flooder) == 3;
+
+    // merged orders count even past the limit, rhs forgets them
+    CQueue bQueue(priorityFn2, MINHEAP, LEFTIST);
+    bQueue.setAdmission(0, 1, 1);
+    result = (bQueue.insertOrder(Order(LATTE, ONE, TIER1, 10, flooder, 100011)) == ADMITTED) && result;
+    result = (bQueue.insertOrder(Order(LATTE, ONE, TIER1, 10, flooder, 100012)) == RATELIMITED) && result;
+    result = (bQueue.insertOrder(Order(LATTE, ONE, TIER1, 10, other, 100013)) == ADMITTED) && result;
+    aQueue.mergeWithQueue(bQueue);
+    result = result && aQueue.getOutstanding(flooder) == 4 && aQueue.getOutstanding(other) == 1;
+    result = result && bQueue.getOutstanding(flooder) == 0 && bQueue.getOutstanding(other) == 0;
+    CQueue::advanceEpoch();
+    result = (aQueue.insertOrder(Order(COFFEE, ONE, TIER1, 10, flooder, 100014)) == CUSTOMERLIMIT) && result;
+
+    CQueue cQueue(aQueue); // copies carry their counters
+    result = result && cQueue.getOutstanding(flooder) == 4;
+    aQueue.clear();
+    result = result && aQueue.numOrders() == 0 && aQueue.getOutstanding(flooder) == 0;
+    result = (aQueue.insertOrder(Order(COFFEE, ONE, TIER1, 10, flooder, 100015)) == ADMITTED) && result;
+    result = result && cQueue.getOutstanding(flooder) == 4;
+
+    aQueue.setAdmission(0, 0, 0); // off, everything valid is admitted
+    try{
+        aQueue.getOutstanding(flooder);
+        result = false;
+    }
+    catch(domain_error const&){
+    }
+    return result;
+}
+//Function: Tester::testTimingWheel
+//Case: Schedule 3000 pre-orders up to 2^25 ticks ahead on a simulated clock, past the top level,
+//cancel every seventh one and advance the clock in small steps and long jumps; then pre-orders
+//against a queue with a limit of two outstanding orders per customer
+//Expected result: after every advance the queue holds exactly the orders that are due and not cancelled;
+//a third pre-order of the customer is rejected when scheduled and the counts follow cancel and release;
+//releases into a queue served by getNextBatch keep its item index
+bool Tester::testTimingWheel() {
+    bool result = true;
+
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    Random dueGen(1, 1 << 25);
+    Random stepGen(0, 20000);
+    CQueue aQueue(priorityFn2, MINHEAP, LEFTIST);
+    TimingWheel aWheel(aQueue, 1000);
+    vector<long long> dues;
+    vector<long long> handles;
+    for (int i=0;i<3000;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      100002 + i);
+        long long due = i < 100 ? 1001 + i : 1000 + dueGen.getRandNum(); // the first hundred on consecutive ticks
+        long long handle;
+        result = (aWheel.schedule(anOrder, due, handle) == ADMITTED) && result;
+        dues.push_back(due);
+        handles.push_back(handle);
+    }
+    long long handle;
+    result = (aWheel.schedule(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100001), 1000, handle) == ADMITTED) && result;
+    result = result && handle == NOHANDLE && aQueue.numOrders() == 1; // already due
+    aQueue.getNextOrder();
+    result = (aWheel.schedule(Order(COFFEE, ONE, TIER1, 0, 0, 100001), 5000, handle) == INVALIDID) && result;
+    vector<bool> cancelled(3000, false);
+    for (int i=0;i<3000;i+=7){
+        result = aWheel.cancel(handles[i]) && result;
+        cancelled[i] = true;
+    }
+    result = result && !aWheel.cancel(handles[0]) && aWheel.numPending() == 3000 - 429;
+    int released = 0;
+    for (int step=0;aWheel.numPending() > 0 && step<100000;step++){
+        long long ticks = step % 50 == 49 ? (1 << 22) : stepGen.getRandNum();
+        released += aWheel.advance(ticks);
+        int expected = 0;
+        for (int i=0;i<3000;i++){
+            if (!cancelled[i] && dues[i] <= aWheel.getTime())
+                expected++;
+        }
+        result = result && aQueue.numOrders() == expected && released == expected;
+    }
+    result = result && aWheel.numPending() == 0 && aWheel.getTime() > (1 << 24); // went through the overflow list
+    result = result && !aWheel.cancel(handles[1]); // released already
+    vector<bool> seen(3000, false);
+    while (aQueue.numOrders() > 0){
+        int index = aQueue.getNextOrder().getOrderID() - 100002;
+        result = result && !cancelled[index] && !seen[index];
+        seen[index] = true;
+    }
+    // pre-orders count against the customer's limit while they wait
+    CQueue limited(priorityFn2, MINHEAP, LEFTIST);
+    limited.setAdmission(2, 0, 0);
+    {
+        TimingWheel limitedWheel(limited, 0);
+        long long first, second, third;
+        result = (limitedWheel.schedule(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100001), 10, first) == ADMITTED) && result;
+        result = (limitedWheel.schedule(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100002), 20, second) == ADMITTED) && result;
+        result = (limitedWheel.schedule(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100003), 30, third) == CUSTOMERLIMIT) && result;
+        result = result && third == NOHANDLE && limited.insertOrder(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100004)) == CUSTOMERLIMIT;
+        result = result && limitedWheel.cancel(second) &&
+                 limitedWheel.schedule(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100003), 30, third) == ADMITTED;
+        result = result && limitedWheel.advance(10) == 1 && limited.getOutstanding(MINCUSTID) == 2;
+        limited.getNextOrder();
+        result = result && limited.getOutstanding(MINCUSTID) == 1 && limitedWheel.numPending() == 1;
+    }
+    result = result && limited.getOutstanding(MINCUSTID) == 0; // the wheel went away with its order
+    // a queue served by batches keeps its item index while the wheel feeds it
+    CQueue batched(priorityFn2, MINHEAP, LEFTIST);
+    TimingWheel batchWheel(batched, 0);
+    for (int i=0;i<60;i++){
+        Order anOrder(static_cast<ITEM>(i % 6), ONE, TIER1, pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(), 110000 + i);
+        if (i < 20)
+            batched.insertOrder(anOrder);
+        else
+            result = (batchWheel.schedule(anOrder, i / 10, handle) == ADMITTED) && result;
+    }
+    int handed = (int)batched.getNextBatch(2).size(); // builds the index
+    for (int tick=0;tick<6;tick++){
+        batchWheel.advance(1);
+        result = result && batched.m_itemIndex;
+    }
+    vector<bool> batchSeen(60, false);
+    while (batched.numOrders() > 0){
+        vector<Order> batch = batched.getNextBatch(2);
+        for (unsigned int i=0;i<batch.size();i++){
+            int index = batch[i].getOrderID() - 110000;
+            result = result && !batchSeen[index] && batch[i].m_item == batch[0].m_item;
+            batchSeen[index] = true;
+            handed++;
+        }
+    }
+    result = result && handed == 60;
+    return result;
+}
+//Function: Tester::testFifoTies
+//Case: 2000 orders with only 11 distinct priorities in all four heap configurations, through a
+//structure change, a bulk load and a wrap of the insertion sequence
+//Expected result: orders with equal priority come out in the order they were inserted
+bool Tester::testFifoTies() {
+    bool result = true;
+
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(0,3); // few points so priorityFn1 ties as well
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    vector<Order> orders;
+    for (int i=0;i<2000;i++){
+        orders.push_back(Order(static_cast<ITEM>(itemGen.getRandNum()),
+                               static_cast<COUNT>(countGen.getRandNum()),
+                               static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                               pointsGen.getRandNum(),
+                               customerIdGen.getRandNum(),
+                               100002 + i)); // IDs grow with insertion order
+    }
+    prifn_t functions[] = {priorityFn2, priorityFn1};
+    HEAPTYPE types[] = {MINHEAP, MAXHEAP};
+    STRUCTURE structures[] = {SKEW, LEFTIST};
+    for (int c=0;c<4;c++){
+        CQueue aQueue(functions[c / 2], types[c / 2], structures[c % 2]);
+        if (c == 3) // start just before the sequence wraps
+            aQueue.m_sequence = UINT_MAX - 700;
+        for (int i=0;i<1000;i++)
+            aQueue.insertOrder(orders[i]);
+        aQueue.setStructure(structures[(c + 1) % 2]); // rebuilds, ties keep their order
+        aQueue.bulkLoad(vector<vector<Order> >(1, vector<Order>(orders.begin() + 1000, orders.end())));
+        prifn_t priFn = functions[c / 2];
+        Order last = aQueue.getNextOrder();
+        while (aQueue.numOrders() > 0){
+            Order next = aQueue.getNextOrder();
+            if (priFn(next) == priFn(last))
+                result = result && next.getOrderID() > last.getOrderID();
+            else if (types[c / 2] == MINHEAP)
+                result = result && priFn(next) > priFn(last);
+            else
+                result = result && priFn(next) < priFn(last);
+            last = next;
+        }
+    }
+    return result;
+}
+//Function: Tester::testPriorityTable
+//Case: priorityFn1 and priorityFn2 compiled from models at compile time, a retuned table swapped in,
+//merges of queues with equal and with different tables
+//Expected result: tables give the same priorities and the same dequeue order as the functions
+bool Tester::testPriorityTable() {
+    bool result = true;
+
+    constexpr PriorityTable table1 = PriorityModel().setCountWeight(1).setPointsWeight(1).compile();
+    constexpr PriorityTable table2 = PriorityModel().setItemWeight(1).setTierWeight(1).compile();
+    static_assert(!(table1 == table2), "the models differ");
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    CQueue fnQueue(priorityFn2, MINHEAP, LEFTIST);
+    CQueue tableQueue(table2, MINHEAP, LEFTIST);
+    for (int i=100002;i<101002;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      i);
+        result = result && table1(anOrder) == priorityFn1(anOrder) && table2(anOrder) == priorityFn2(anOrder);
+        fnQueue.insertOrder(anOrder);
+        tableQueue.insertOrder(anOrder);
+    }
+    result = result && tableQueue.getPriorityFn() == nullptr && tableQueue.getPriorityTable() == table2;
+    fnQueue.setPriorityFn(priorityFn1, MAXHEAP);
+    tableQueue.setPriorityFn(table1, MAXHEAP);
+    result = result && tableQueue.helpHeapProperty(tableQueue.m_heap);
+    CQueue copyQueue(tableQueue);
+    for (int i=0;i<500;i++) // ties go first in first out, so the order IDs match
+        result = result && fnQueue.getNextOrder().getOrderID() == tableQueue.getNextOrder().getOrderID();
+
+    // retuning is swapping the table: latte first, then everything else by tier
+    PriorityTable latteFirst = PriorityModel().setItemWeight(10).setTierWeight(1)
+                                              .setItemValue(COFFEE, 1).setItemValue(LATTE, 0)
+                                              .setItemValue(SOFTDRINK, 1).setItemValue(MILK, 1)
+                                              .setItemValue(WATER, 1).setItemValue(ICEDTEA, 1).compile();
+    tableQueue.setPriorityFn(latteFirst, MINHEAP);
+    bool lattes = true;
+    while (tableQueue.numOrders() > 0){
+        Order order = tableQueue.getNextOrder();
+        result = result && (lattes || order.getItem() != LATTE); // no latte after the first other item
+        lattes = lattes && order.getItem() == LATTE;
+    }
+    CQueue sameQueue(table1, MAXHEAP, LEFTIST);
+    sameQueue.insertOrder(Order(COFFEE, ONE, TIER1, 10, MINCUSTID, 200000));
+    copyQueue.mergeWithQueue(sameQueue);
+    result = result && copyQueue.numOrders() == 1001;
+    CQueue otherQueue(latteFirst, MAXHEAP, LEFTIST); // re-keyed with table1
+    otherQueue.insertOrder(Order(COFFEE, ONE, TIER1, 10, MINCUSTID, 200001));
+    copyQueue.mergeWithQueue(otherQueue);
+    result = result && copyQueue.numOrders() == 1002 && copyQueue.getPriorityTable() == table1;
+    result = result && copyQueue.helpHeapProperty(copyQueue.m_heap);
+    return result;
+}
+//Function: Tester::testOrderBatch
+//Case: 70001 orders in an OrderBatch, a few with invalid IDs, evaluated by a table and bulk loaded
+//into table and function queues, then rebuilt with setPriorityFn
+//Expected result: batch priorities match the functions, invalid orders are dropped and all queues
+//dequeue the same orders in the same order
+bool Tester::testOrderBatch() {
+    bool result = true;
+
+    constexpr PriorityTable table1 = PriorityModel().setCountWeight(1).setPointsWeight(1).compile();
+    constexpr PriorityTable table2 = PriorityModel().setItemWeight(1).setTierWeight(1).compile();
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    vector<Order> orders;
+    for (int i=0;i<70001;i++){
+        orders.push_back(Order(static_cast<ITEM>(itemGen.getRandNum()),
+                               static_cast<COUNT>(countGen.getRandNum()),
+                               static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                               pointsGen.getRandNum(),
+                               i % 1000 == 999 ? 0 : customerIdGen.getRandNum(), // 70 invalid
+                               100002 + i));
+    }
+    OrderBatch batch(orders);
+    result = result && batch.size() == 70001 && batch.getOrder(12345).getOrderID() == orders[12345].getOrderID();
+    vector<int> priorities(batch.size());
+    table1.evaluate(batch, 0, batch.size(), priorities.data());
+    for (int i=0;i<batch.size();i++)
+        result = result && priorities[i] == priorityFn1(orders[i]);
+    table2.evaluate(batch, 3, 13, priorities.data()); // a vector and a tail
+    for (int i=0;i<13;i++)
+        result = result && priorities[i] == priorityFn2(orders[3 + i]);
+
+    CQueue fnQueue(priorityFn2, MINHEAP, LEFTIST);
+    CQueue tableQueue(table2, MINHEAP, SKEW);
+    CQueue backlogQueue(table2, MINHEAP, LEFTIST);
+    fnQueue.bulkLoad(batch);
+    tableQueue.bulkLoad(batch);
+    backlogQueue.bulkLoad(vector<vector<Order> >(1, orders));
+    result = result && fnQueue.numOrders() == 70001 - 70 && tableQueue.numOrders() == 70001 - 70;
+    result = result && backlogQueue.numOrders() == 70001 - 70;
+    fnQueue.setPriorityFn(priorityFn1, MAXHEAP);
+    tableQueue.setPriorityFn(table1, MAXHEAP);
+    backlogQueue.setPriorityFn(table1, MAXHEAP);
+    result = result && tableQueue.helpHeapProperty(tableQueue.m_heap);
+    while (fnQueue.numOrders() > 0){ // ties go first in first out, so the IDs match
+        int id = fnQueue.getNextOrder().getOrderID();
+        result = result && tableQueue.getNextOrder().getOrderID() == id;
+        result = result && backlogQueue.getNextOrder().getOrderID() == id;
+    }
+    return result;
+}
+//Function: Tester::testOrderStore
+//Case: 3000 orders in a queue, drained and inserted again, 40 single order queues merged in,
+//a 2000 order queue merged in, then the queue is copied and drained next to the copy; a queue is
+//copied and assigned after a batch took a whole item
+//Expected result: the drain gives back all blocks but one, freed slots are reused, small merges are
+//copied into the existing blocks, large merges hand over their blocks, the copy has its own blocks
+//and every order comes out intact; the copies leave out the taken orders
+bool Tester::testOrderStore() {
+    bool result = true;
+
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    vector<Order> orders;
+    for (int i=0;i<5040;i++){
+        orders.push_back(Order(static_cast<ITEM>(itemGen.getRandNum()),
+                               static_cast<COUNT>(countGen.getRandNum()),
+                               static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                               pointsGen.getRandNum(),
+                               customerIdGen.getRandNum(),
+                               100002 + i));
+    }
+    CQueue aQueue(priorityFn2, MINHEAP, SKEW);
+    for (int i=0;i<3000;i++)
+        aQueue.insertOrder(orders[i]);
+    result = result && aQueue.m_store.numBlocks() == 3; // 1024 orders per block
+    while (aQueue.numOrders() > 0)
+        aQueue.getNextOrder();
+    result = result && aQueue.m_store.numBlocks() == 1; // emptied blocks are given back
+    for (int i=0;i<3000;i++)
+        aQueue.insertOrder(orders[i]);
+    result = result && aQueue.m_store.numBlocks() == 3;
+    for (int i=3000;i<3040;i++){
+        CQueue single(priorityFn2, MINHEAP, SKEW);
+        single.insertOrder(orders[i]);
+        aQueue.mergeWithQueue(single);
+        result = result && single.m_store.numBlocks() == 0;
+    }
+    result = result && aQueue.m_store.numBlocks() == 3 && aQueue.numOrders() == 3040;
+    CQueue bQueue(priorityFn2, MINHEAP, SKEW);
+    bQueue.bulkLoad(vector<vector<Order> >(1, vector<Order>(orders.begin() + 3040, orders.end())));
+    aQueue.mergeWithQueue(bQueue);
+    result = result && aQueue.m_store.numBlocks() == 5 && bQueue.m_store.numBlocks() == 0;
+    CQueue cQueue(aQueue);
+    result = result && cQueue.m_store.numBlocks() == 5 && aQueue.helpDeepCopyCheck(aQueue.m_heap, cQueue.m_heap);
+    vector<bool> seen(orders.size(), false);
+    while (aQueue.numOrders() > 0){
+        Order order = aQueue.getNextOrder();
+        Order copy = cQueue.getNextOrder();
+        const Order& original = orders[order.getOrderID() - 100002];
+        result = result && !seen[order.getOrderID() - 100002];
+        seen[order.getOrderID() - 100002] = true;
+        result = result && copy.getOrderID() == order.getOrderID();
+        result = result && order.getCustomerID() == original.getCustomerID() && order.getPoints() == original.getPoints();
+        result = result && order.getItem() == original.getItem() && order.getCount() == original.getCount();
+        result = result && order.getMemebership() == original.getMemebership();
+    }
+    // orders a batch took stay in the heap of the original until they surface,
+    // the copies leave them out and give their slots back
+    CQueue dQueue(priorityFn2, MINHEAP, SKEW);
+    for (int i=0;i<3000;i++)
+        dQueue.insertOrder(orders[i]);
+    int taken = (int)dQueue.getNextBatch(100000).size(); // a whole item
+    CQueue eQueue(dQueue);
+    CQueue fQueue(priorityFn1, MAXHEAP, LEFTIST);
+    fQueue = dQueue;
+    result = result && taken > 100 && eQueue.m_pool.live() == 3000 - taken && fQueue.m_pool.live() == 3000 - taken;
+    while (eQueue.numOrders() > 0){
+        int id = dQueue.getNextOrder().getOrderID();
+        int copyId = eQueue.getNextOrder().getOrderID();
+        int assignedId = fQueue.getNextOrder().getOrderID();
+        result = result && copyId == id && assignedId == id;
+    }
+    result = result && eQueue.m_store.numBlocks() == 1 && fQueue.m_store.numBlocks() == 1;
+    result = result && eQueue.m_pool.live() == 0 && fQueue.m_pool.live() == 0;
+    return result;
+}
+//Function: Tester::testDegenerateSkew
+//Case: a skew heap of 10 million orders that is one long right spine, copied, inserted into
+//(the merge walks the whole spine), rebuilt as a leftist heap and destroyed
+//Expected result: nothing recurses along the spine, so there is no stack overflow, the copy is
+//complete and both queues still hand out the best order first
+bool Tester::testDegenerateSkew() {
+    bool result = true;
+    const int depth = 10000000;
+
+    CQueue aQueue(priorityFn2, MINHEAP, SKEW);
+    Order best(COFFEE, ONE, TIER1, 0, MINCUSTID, MINORDERID); // priority 0
+    Node *spine = nullptr;
+    for (int i = depth - 1; i >= 0; i--){ // the root has the smallest sequence
+        best.setOrderID(MINORDERID + i % (MAXORDERID - MINORDERID));
+        Node *node = aQueue.m_pool.allocate(aQueue.m_store.add(best, 0));
+        node->m_key = aQueue.helpKey(best, 0, i);
+        node->m_right = spine;
+        spine = node;
+    }
+    aQueue.m_heap = spine;
+    aQueue.m_size = depth;
+    aQueue.m_sequence = depth;
+    CQueue bQueue(aQueue);
+    result = result && bQueue.numOrders() == depth && bQueue.m_heap != aQueue.m_heap;
+    aQueue.insertOrder(Order(LATTE, ONE, TIER1, 0, MINCUSTID, MINORDERID)); // priority 1, goes last
+    result = result && aQueue.numOrders() == depth + 1;
+    result = result && aQueue.getNextOrder().getOrderID() == MINORDERID;
+    bQueue.setStructure(LEFTIST);
+    result = result && bQueue.helpCheckLeftProperty(bQueue.m_heap);
+    result = result && bQueue.getNextOrder().getOrderID() == MINORDERID;
+    result = result && bQueue.getNextOrder().getOrderID() == MINORDERID + 1;
+    return result;
+}
+//Function: Tester::testPersistentSnapshot
+//Case: a snapshot of a 500 order PersistentCQueue is taken, then the queue takes 500 more orders,
+//gives out 300 and merges another queue while a second thread drains the snapshot
+//Expected result: the copy shares the root, the snapshot still holds the 500 orders and both come
+//out in the same order as from CQueues that got the same operations
+bool Tester::testPersistentSnapshot() {
+    bool result = true;
+
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    vector<Order> orders;
+    for (int i=0;i<1200;i++){
+        orders.push_back(Order(static_cast<ITEM>(itemGen.getRandNum()),
+                               static_cast<COUNT>(countGen.getRandNum()),
+                               static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                               pointsGen.getRandNum(),
+                               customerIdGen.getRandNum(),
+                               100002 + i));
+    }
+    PersistentCQueue aQueue(priorityFn2, MINHEAP);
+    CQueue aReference(priorityFn2, MINHEAP, LEFTIST);
+    for (int i=0;i<500;i++){
+        aQueue.insertOrder(orders[i]);
+        aReference.insertOrder(orders[i]);
+    }
+    PersistentCQueue snapshot(aQueue);
+    CQueue snapshotReference(aReference);
+    result = result && snapshot.m_root == aQueue.m_root && snapshot.numOrders() == 500;
+    vector<int> snapshotIDs;
+    thread reader([&snapshot, &snapshotIDs]() {
+        while (snapshot.numOrders() > 0)
+            snapshotIDs.push_back(snapshot.getNextOrder().getOrderID());
+    });
+    PersistentCQueue bQueue(priorityFn2, MINHEAP);
+    CQueue bReference(priorityFn2, MINHEAP, LEFTIST);
+    for (int i=500;i<1000;i++){
+        aQueue.insertOrder(orders[i]);
+        aReference.insertOrder(orders[i]);
+        if (i % 5 == 0){
+            result = result && aQueue.getNextOrder().getOrderID() == aReference.getNextOrder().getOrderID();
+            result = result && aQueue.getNextOrder().getOrderID() == aReference.getNextOrder().getOrderID();
+            result = result && aQueue.getNextOrder().getOrderID() == aReference.getNextOrder().getOrderID();
+        }
+    }
+    for (int i=1000;i<1200;i++){
+        bQueue.insertOrder(orders[i]);
+        bReference.insertOrder(orders[i]);
+    }
+    aQueue.mergeWithQueue(bQueue);
+    aReference.mergeWithQueue(bReference);
+    result = result && aQueue.numOrders() == 900 && bQueue.numOrders() == 0;
+    vector<Order> listed = aQueue.getOrders();
+    result = result && (int)listed.size() == 900;
+    while (aQueue.numOrders() > 0)
+        result = result && aQueue.getNextOrder().getOrderID() == aReference.getNextOrder().getOrderID();
+    reader.join();
+    result = result && snapshotIDs.size() == 500;
+    for (unsigned int i=0;i<snapshotIDs.size();i++)
+        result = result && snapshotIDs[i] == snapshotReference.getNextOrder().getOrderID();
+    try{
+        PersistentCQueue cQueue(priorityFn1, MAXHEAP);
+        aQueue.mergeWithQueue(cQueue);
+        result = false;
+    }
+    catch(domain_error &e){
+    }
+    return result;
+}
+//Function: Tester::testCompact
+//Case: two skew queues get the same inserts, pops and batches, which build the item index and leave
+//taken orders in both structures, then one is compacted. A third queue with a threshold of 0.5 gets
+//pop/insert rounds, then only pops, and is offered maybeCompact() along the way. A fourth queue of
+//200000 orders is shrunk after most pops, then drained, and drained once more without the shrink.
+//Expected result: the compacted heap has the same shape in one block with the root spine first,
+//both queues hand out the same orders and batches; the rounds never reach the threshold, the pops do;
+//the shrink leaves one block of the live nodes, a drained pool keeps at most NODEBLOCKMAX nodes
+bool Tester::testCompact() {
+    bool result = true;
+
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    vector<Order> orders;
+    for (int i=0;i<4000;i++){
+        orders.push_back(Order(static_cast<ITEM>(itemGen.getRandNum()),
+                               static_cast<COUNT>(countGen.getRandNum()),
+                               static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                               pointsGen.getRandNum(),
+                               customerIdGen.getRandNum(),
+                               MINORDERID+i));
+    }
+    CQueue aQueue(priorityFn2, MINHEAP, SKEW);
+    CQueue bQueue(priorityFn2, MINHEAP, SKEW);
+    CQueue *queues[] = {&aQueue, &bQueue};
+    for (int q=0;q<2;q++){
+        for (int i=0;i<3000;i++){
+            queues[q]->insertOrder(orders[i]);
+        }
+        for (int i=0;i<1000;i++){
+            queues[q]->getNextOrder();
+        }
+        for (int i=3000;i<4000;i++){
+            queues[q]->insertOrder(orders[i]);
+        }
+        for (int i=0;i<50;i++){
+            queues[q]->getNextBatch(6);
+        }
+    }
+    result = result && aQueue.getFragmentation() > 0;
+    aQueue.compact();
+    result = result && aQueue.getFragmentation() == 0 && aQueue.m_pool.m_blocks.size() == 1;
+    result = result && aQueue.m_heap == aQueue.m_pool.m_blocks[0].first;
+    result = result && aQueue.m_heap->m_right == aQueue.m_heap + 1;
+    result = result && aQueue.helpDeepCopyCheck(aQueue.m_heap, bQueue.m_heap) && aQueue.helpHeapProperty(aQueue.m_heap);
+    while (bQueue.numOrders() > 0){
+        vector<Order> first = aQueue.getNextBatch(6);
+        vector<Order> second = bQueue.getNextBatch(6);
+        result = result && first.size() == second.size();
+        for (unsigned int i=0;i<first.size() && i<second.size();i++){
+            result = result && first[i].getOrderID() == second[i].getOrderID();
+        }
+        if (bQueue.numOrders() > 0){
+            result = result && aQueue.getNextOrder().getOrderID() == bQueue.getNextOrder().getOrderID();
+        }
+    }
+    result = result && aQueue.numOrders() == 0;
+
+    CQueue cQueue(priorityFn2, MINHEAP, LEFTIST);
+    cQueue.setCompaction(0.5);
+    for (int i=0;i<2000;i++){
+        cQueue.insertOrder(orders[i]);
+    }
+    for (int i=2000;i<4000;i++){ // freed nodes are reused, there is nothing to close
+        cQueue.getNextOrder();
+        cQueue.insertOrder(orders[i]);
+        result = result && !cQueue.maybeCompact();
+    }
+    for (int i=0;i<1200;i++){ // pops leave the holes to the owner
+        cQueue.getNextOrder();
+    }
+    result = result && cQueue.getFragmentation() > 0.5 && cQueue.maybeCompact();
+    result = result && cQueue.getFragmentation() == 0 && !cQueue.maybeCompact();
+    result = result && cQueue.helpCheckLeftProperty(cQueue.m_heap) && cQueue.numOrders() == 800;
+
+    // a large pool gives its blocks back when drained, or when shrunk by the owner
+    CQueue dQueue(priorityFn2, MINHEAP, SKEW);
+    for (int round=0;round<2;round++){
+        for (int i=0;i<200000;i++){
+            dQueue.insertOrder(orders[i % 4000]);
+        }
+        for (int i=0;i<160000;i++){
+            dQueue.getNextOrder();
+        }
+        if (round == 0){ // compaction is off, this is the shrink
+            result = result && dQueue.maybeCompact() && dQueue.m_pool.capacity() == 40000;
+            result = result && !dQueue.maybeCompact();
+        }
+        while (dQueue.numOrders() > 0){
+            dQueue.getNextOrder();
+        }
+        if (round == 0) // a pool of up to one full block is kept for the next orders
+            result = result && dQueue.m_pool.capacity() == 40000;
+        else
+            result = result && dQueue.m_pool.capacity() == 0 && dQueue.m_pool.m_blocks.empty();
+    }
+    try{
+        cQueue.setCompaction(1.5);
+        result = false;
+    }
+    catch(out_of_range &e){
+    }
+    return result;
+}
+//Function: Tester::testLazyMerge
+//Case: an eager and a lazy queue of 100 orders each merge seven queues of 100 orders, the lazy one
+//is copied and merged into an empty lazy queue and into an eager queue, priorities are all different
+//Expected result: the lazy merges only link the heaps, copies keep them, the eager queue melds what
+//a lazy rhs had pending, and every queue hands out its orders in the order of the eager one
+bool Tester::testLazyMerge() {
+    bool result = true;
+
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random itemGen(0,5); // there are six items
+    vector<Order> orders;
+    for (int i=0;i<850;i++){ // priorityFn1 is the points for a count of ONE
+        orders.push_back(Order(static_cast<ITEM>(itemGen.getRandNum()), ONE,
+                               static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                               (i * 37) % 850, customerIdGen.getRandNum(), MINORDERID+i));
+    }
+    CQueue eager(priorityFn1, MAXHEAP, SKEW);
+    CQueue lazy(priorityFn1, MAXHEAP, SKEW);
+    lazy.setLazyMerge(true);
+    for (int i=0;i<100;i++){
+        eager.insertOrder(orders[i]);
+        lazy.insertOrder(orders[i]);
+    }
+    for (int k=1;k<8;k++){
+        CQueue source(priorityFn1, MAXHEAP, SKEW);
+        for (int i=100*k;i<100*k+100;i++){
+            source.insertOrder(orders[i]);
+        }
+        CQueue copy(source);
+        eager.mergeWithQueue(source);
+        lazy.mergeWithQueue(copy);
+        result = result && copy.numOrders() == 0 && copy.m_heap == nullptr;
+    }
+    result = result && eager.m_pending.empty() && lazy.m_pending.size() == 7;
+    result = result && lazy.numOrders() == 800 && lazy.getLazyMerge();
+    CQueue eagerCopy(eager);
+    CQueue lazyCopy(lazy);
+    CQueue lazyCopy2(lazy);
+    result = result && lazyCopy.m_pending.size() == 7 && lazyCopy.m_pending[0] != lazy.m_pending[0];
+    CQueue target(priorityFn1, MAXHEAP, SKEW); // empty, takes the heap and the pending ones
+    target.setLazyMerge(true);
+    target.mergeWithQueue(lazyCopy);
+    result = result && target.m_pending.size() == 7 && lazyCopy.m_pending.empty();
+    CQueue eagerTarget(priorityFn1, MAXHEAP, SKEW);
+    for (int i=800;i<850;i++){
+        eagerTarget.insertOrder(orders[i]);
+    }
+    eagerTarget.mergeWithQueue(lazyCopy2);
+    result = result && eagerTarget.m_pending.empty() && eagerTarget.numOrders() == 850;
+    result = result && eagerTarget.helpHeapProperty(eagerTarget.m_heap);
+    result = result && lazy.getTopKey() == eager.getTopKey() && lazy.m_pending.empty();
+    while (eager.numOrders() > 0){
+        int id = eager.getNextOrder().getOrderID();
+        result = result && lazy.getNextOrder().getOrderID() == id;
+        result = result && target.getNextOrder().getOrderID() == eagerCopy.getNextOrder().getOrderID();
+    }
+    result = result && lazy.numOrders() == 0 && target.numOrders() == 0;
+    return result;
+}
+//Function: Tester::testMergeAll
+//Case: eleven queues of up to 100 orders, two of them empty, are merged by mergeAll sequentially
+//and, as copies, in parallel on four threads, a twelfth queue with another structure is refused
+//Expected result: a mismatched or repeated queue throws domain_error and a nullptr invalid_argument,
+//leaving the queues alone, both results hold every order, all queues are left empty and the orders
+//come out in the same order as after merging one queue after the other, also once the results are
+//moved. Rate limited queues pass on the emptiest bucket of each customer
+bool Tester::testMergeAll() {
+    bool result = true;
+
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random itemGen(0,5); // there are six items
+    vector<CQueue> queues(11, CQueue(priorityFn1, MAXHEAP, LEFTIST));
+    CQueue reference(priorityFn1, MAXHEAP, LEFTIST);
+    int total = 0;
+    for (int q=0;q<11;q++){
+        int count = (q == 3 || q == 8) ? 0 : 50 + 5 * q;
+        for (int i=0;i<count;i++){ // priorityFn1 is the points for a count of ONE, all different
+            Order anOrder(static_cast<ITEM>(itemGen.getRandNum()), ONE,
+                          static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                          (total * 37) % 1000, customerIdGen.getRandNum(), MINORDERID+total);
+            queues[q].insertOrder(anOrder);
+            reference.insertOrder(anOrder);
+            total++;
+        }
+    }
+    vector<CQueue> copies(queues);
+    vector<CQueue*> pointers;
+    vector<CQueue*> copyPointers;
+    for (int q=0;q<11;q++){
+        pointers.push_back(&queues[q]);
+        copyPointers.push_back(&copies[q]);
+    }
+    CQueue skew(priorityFn1, MAXHEAP, SKEW);
+    skew.insertOrder(Order(COFFEE, ONE, TIER1, 999, MINCUSTID, MINORDERID));
+    vector<CQueue*> mismatched(pointers);
+    mismatched.push_back(&skew);
+    vector<CQueue*> repeated(pointers);
+    repeated.push_back(&queues[5]);
+    vector<CQueue*> *refused[] = {&mismatched, &repeated};
+    for (int r=0;r<2;r++){
+        try{
+            CQueue::mergeAll(span<CQueue*>(*refused[r]));
+            result = false;
+        }
+        catch(domain_error &e){
+        }
+    }
+    vector<CQueue*> missing(pointers);
+    missing.push_back(nullptr);
+    try{
+        CQueue::mergeAll(span<CQueue*>(missing));
+        result = false;
+    }
+    catch(invalid_argument &e){
+    }
+    result = result && queues[0].numOrders() == 50 && queues[10].numOrders() == 100 && skew.numOrders() == 1;
+    CQueue sequential = CQueue::mergeAll(span<CQueue*>(pointers));
+    ThreadPool::shared().resize(3); // the caller is the fourth thread
+    CQueue parallel = CQueue::mergeAll(span<CQueue*>(copyPointers), true);
+    ThreadPool::shared().resize(thread::hardware_concurrency() > 1 ? thread::hardware_concurrency() - 1 : 0);
+    result = result && sequential.numOrders() == total && parallel.numOrders() == total;
+    result = result && sequential.getStructure() == LEFTIST && sequential.helpCheckLeftProperty(sequential.m_heap);
+    for (int q=0;q<11;q++){
+        result = result && queues[q].numOrders() == 0 && copies[q].numOrders() == 0;
+    }
+    CQueue moved(std::move(sequential)); // the nodes move along, nothing is copied
+    CQueue assigned(priorityFn2, MINHEAP, SKEW);
+    assigned = std::move(parallel);
+    result = result && sequential.numOrders() == 0 && parallel.numOrders() == 0;
+    result = result && assigned.getStructure() == LEFTIST && assigned.getPriorityFn() == priorityFn1;
+    while (reference.numOrders() > 0){
+        int id = reference.getNextOrder().getOrderID();
+        result = result && moved.getNextOrder().getOrderID() == id;
+        result = result && assigned.getNextOrder().getOrderID() == id;
+    }
+
+    // a customer that used up its burst in one queue gets no fresh one from the merge
+    CQueue spent(priorityFn1, MAXHEAP, LEFTIST);
+    CQueue unused(priorityFn1, MAXHEAP, LEFTIST);
+    spent.setAdmission(0, 1, 2);
+    unused.setAdmission(0, 1, 2);
+    for (int i=0;i<2;i++){
+        result = result && spent.insertOrder(Order(COFFEE, ONE, TIER1, 10, MINCUSTID, MINORDERID+i)) == ADMITTED;
+    }
+    unused.insertOrder(Order(COFFEE, ONE, TIER1, 10, MINCUSTID+1, MINORDERID+2));
+    CQueue *limited[] = {&unused, &spent};
+    CQueue merged = CQueue::mergeAll(limited);
+    result = result && merged.numOrders() == 3 && merged.getOutstanding(MINCUSTID) == 2;
+    result = result && merged.insertOrder(Order(COFFEE, ONE, TIER1, 10, MINCUSTID, MINORDERID+3)) == RATELIMITED;
+    result = result && merged.insertOrder(Order(COFFEE, ONE, TIER1, 10, MINCUSTID+1, MINORDERID+4)) == ADMITTED;
+    return result;
+}
+//Function: Tester::testCrossMerge
+//Case: a skew MINHEAP queue of 100 orders on priorityFn2, after a few batches, is merged into a
+//leftist MAXHEAP queue of 300 orders on priorityFn1, and the other way round with a fresh pair
+//Expected result: the smaller queue is rebuilt either way, the result has the configuration of the
+//larger one, a valid leftist heap, and hands out every order once in priorityFn1 order; the emptied
+//queue keeps its own configuration. A queue emptied by a batch is merged into a lazy one, then both
+//go through mergeAll
+//Expected result: the queue left with taken nodes only is refused by mergeWithQueue, no empty root is
+//left pending and mergeAll hands out the rest in order
+bool Tester::testCrossMerge() {
+    bool result = true;
+
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    vector<Order> orders;
+    for (int i=0;i<400;i++){
+        orders.push_back(Order(static_cast<ITEM>(itemGen.getRandNum()),
+                               static_cast<COUNT>(countGen.getRandNum()),
+                               static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                               pointsGen.getRandNum(),
+                               customerIdGen.getRandNum(),
+                               MINORDERID+i));
+    }
+    for (int round=0;round<2;round++){
+        CQueue large(priorityFn1, MAXHEAP, LEFTIST);
+        CQueue small(priorityFn2, MINHEAP, SKEW);
+        for (int i=0;i<300;i++){
+            large.insertOrder(orders[i]);
+        }
+        for (int i=300;i<400;i++){
+            small.insertOrder(orders[i]);
+        }
+        vector<bool> seen(400, false);
+        int handedOut = 0;
+        for (int i=0;i<5;i++){ // leaves taken orders in the main heap and the index
+            vector<Order> batch = small.getNextBatch(8);
+            for (unsigned int j=0;j<batch.size();j++){
+                seen[batch[j].getOrderID() - MINORDERID] = true;
+                handedOut++;
+            }
+        }
+        CQueue *merged = &large;
+        if (round == 0){
+            large.mergeWithQueue(small);
+            result = result && small.numOrders() == 0;
+        }
+        else{
+            small.mergeWithQueue(large);
+            merged = &small;
+            result = result && large.numOrders() == 0;
+        }
+        // the emptied queue keeps its own configuration
+        CQueue *emptied = round == 0 ? &small : &large;
+        result = result && emptied->getPriorityFn() == (round == 0 ? priorityFn2 : priorityFn1);
+        result = result && emptied->getStructure() == (round == 0 ? SKEW : LEFTIST);
+        result = result && merged->getPriorityFn() == priorityFn1 && merged->getHeapType() == MAXHEAP;
+        result = result && merged->getStructure() == LEFTIST && merged->numOrders() == 400 - handedOut;
+        result = result && merged->helpCheckLeftProperty(merged->m_heap) && merged->helpHeapProperty(merged->m_heap);
+        int prev = INT_MAX;
+        while (merged->numOrders() > 0){
+            Order order = merged->getNextOrder();
+            result = result && priorityFn1(order) <= prev && !seen[order.getOrderID() - MINORDERID];
+            seen[order.getOrderID() - MINORDERID] = true;
+            prev = priorityFn1(order);
+        }
+        for (int i=0;i<400;i++){
+            result = result && seen[i];
+        }
+    }
+    // a queue whose orders all went out in a batch still holds the taken nodes
+    CQueue drained(priorityFn2, MINHEAP, SKEW);
+    for (int i=0;i<20;i++){
+        drained.insertOrder(Order(LATTE, ONE, orders[i].m_membership, orders[i].m_points,
+                                  orders[i].m_customerID, MINORDERID+i));
+    }
+    result = result && (int)drained.getNextBatch(1000).size() == 20 && drained.numOrders() == 0;
+    CQueue lazy(priorityFn1, MAXHEAP, LEFTIST);
+    lazy.setLazyMerge(true);
+    for (int i=20;i<30;i++){
+        lazy.insertOrder(orders[i]);
+    }
+    try{
+        lazy.mergeWithQueue(drained);
+        result = false;
+    }
+    catch(domain_error &e){
+        result = result && lazy.numOrders() == 10;
+    }
+    CQueue other(priorityFn1, MAXHEAP, LEFTIST);
+    other.insertOrder(orders[30]);
+    lazy.mergeWithQueue(other); // pending now
+    CQueue sameConfig(priorityFn2, MINHEAP, SKEW);
+    sameConfig.insertOrder(orders[31]);
+    drained.mergeWithQueue(sameConfig); // nothing taken is merged back
+    CQueue *both[] = {&lazy, &other};
+    CQueue all = CQueue::mergeAll(both);
+    result = result && all.numOrders() == 11 && drained.numOrders() == 1;
+    int prev = INT_MAX;
+    while (all.numOrders() > 0){
+        Order order = all.getNextOrder();
+        result = result && priorityFn1(order) <= prev;
+        prev = priorityFn1(order);
+    }
+    return result;
+}
+//Function: Tester::testIncrementalRekey
+//Case: A curve-aged queue of 2000 orders from one epoch and newer orders once the interval has passed;
+//a copy, pops and a merge while the re-key is under way, then a batch. Then orders from two epochs whose
+//order the quadratic curve turns around
+//Expected result: no insert re-keys more than REKEYSTEP nodes, the first pop re-keys the rest, orders come
+//out by their fresh keys and the older order overtakes the younger ones the stale heap ranked first
+bool Tester::testIncrementalRekey() {
+    bool result = true;
+
+    Random customerIdGen(MINCUSTID,MAXCUSTID);
+    customerIdGen.setSeed(0);
+    Random membershipGen(0,5); // there are six tiers
+    Random pointsGen(MINPOINTS,MAXPOINTS);
+    Random itemGen(0,5); // there are six items
+    Random countGen(0,3); // there are three possible quantity values
+    CQueue aQueue(priorityFn2, MINHEAP, LEFTIST);
+    aQueue.setAgingCurve(squareAging, 5);
+    for (int i=0;i<2000;i++){
+        Order anOrder(static_cast<ITEM>(itemGen.getRandNum()),
+                      static_cast<COUNT>(countGen.getRandNum()),
+                      static_cast<MEMBERSHIP>(membershipGen.getRandNum()),
+                      pointsGen.getRandNum(),
+                      customerIdGen.getRandNum(),
+                      100002 + i);
+        aQueue.insertOrder(anOrder);
+    }
+    CQueue::advanceEpoch(5);
+    aQueue.insertOrder(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100001)); // starts the re-key
+    int fresh = 0;
+    vector<Node*> stack(1, aQueue.m_heap);
+    while (!stack.empty()){
+        Node *curr = stack.back();
+        stack.pop_back();
+        fresh++;
+        if (curr->m_left != nullptr)
+            stack.push_back(curr->m_left);
+        if (curr->m_right != nullptr)
+            stack.push_back(curr->m_right);
+    }
+    result = result && aQueue.m_stale != nullptr && fresh == REKEYSTEP + 1;
+    for (int i=0;i<10;i++){ // inserts keep moving a few
+        aQueue.insertOrder(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 100001 + 3000 + i));
+    }
+    result = result && aQueue.m_stale != nullptr;
+    CQueue copy(aQueue);
+    result = result && copy.m_stale != nullptr && copy.numOrders() == aQueue.numOrders();
+    // the old orders waited 5 epochs (bonus 25), the new ones none
+    auto effective = [](const Order& order) {
+        return priorityFn2(order) - (order.getOrderID() == 100001 || order.getOrderID() > 103000 ? 0 : squareAging(5));
+    };
+    long long prev = LLONG_MIN;
+    for (int i=0;i<100;i++){ // the first pop re-keys the rest
+        Order order = aQueue.getNextOrder();
+        result = result && effective(order) >= prev && aQueue.m_stale == nullptr;
+        prev = effective(order);
+    }
+    result = result && aQueue.helpCalcNpl2(aQueue.m_heap);
+    aQueue.mergeWithQueue(copy); // the stale orders of the copy are re-keyed first
+    result = result && copy.m_stale == nullptr && aQueue.numOrders() == 2 * 2011 - 100;
+    for (int i=0;i<100;i++){
+        Order order = aQueue.getNextOrder();
+        result = result && effective(order) >= prev;
+        prev = effective(order);
+    }
+    vector<Order> batch = aQueue.getNextBatch(10);
+    result = result && aQueue.m_stale == nullptr && aQueue.helpCalcNpl2(aQueue.m_heap) && batch.size() >= 1;
+    int remaining = aQueue.numOrders();
+    prev = LLONG_MIN;
+    for (int i=0;i<remaining;i++){
+        Order order = aQueue.getNextOrder();
+        result = result && effective(order) >= prev;
+        prev = effective(order);
+    }
+
+    // orders from two epochs: the curve gives the older ones a larger share of the
+    // new bonus, so they overtake younger orders the stale heap still ranks first
+    CQueue bQueue(priorityFn2, MINHEAP, SKEW);
+    bQueue.setAgingCurve(squareAging, 5);
+    bQueue.insertOrder(Order(ICEDTEA, ONE, static_cast<MEMBERSHIP>(5), 0, MINCUSTID, 104000)); // 10
+    CQueue::advanceEpoch(4);
+    for (int i=0;i<50;i++){
+        bQueue.insertOrder(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 104001 + i)); // 0
+    }
+    CQueue::advanceEpoch(1); // 10 - 25 against 0 - 1
+    bQueue.insertOrder(Order(COFFEE, ONE, TIER1, 0, MINCUSTID, 104100)); // starts the re-key
+    result = result && bQueue.m_stale != nullptr;
+    result = result && bQueue.getTopKey() == -15 && bQueue.getNextOrder().getOrderID() == 104000;
+    while (bQueue.numOrders() > 1){
+        int id = bQueue.getNextOrder().getOrderID();
+        result = result && id != 104100; // the fresh one goes last
+    }
+    return result;
+}
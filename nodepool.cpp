@@ -0,0 +1,118 @@
+#include "cqueue.h"
+#include <new>
+
+NodePool::NodePool()
+    : m_free(nullptr), m_lastFree(nullptr), m_capacity(0), m_live(0), m_holes(0) {}
+NodePool::~NodePool() {
+    clear();
+}
+Node *NodePool::allocate(unsigned int handle) {
+    Node *node = m_free;
+    if (node != nullptr) {
+        m_free = node->m_left;
+        if (m_free == nullptr) {
+            m_lastFree = nullptr;
+        }
+        m_holes -= 1;
+    }
+    else {
+        if (m_regions.empty()) { // doubles the pool, within the limits
+            long long count = m_capacity < NODEBLOCKMIN ? NODEBLOCKMIN : m_capacity;
+            count = count > NODEBLOCKMAX ? NODEBLOCKMAX : count;
+            Node *block = addBlock((int)count);
+            m_regions.push_back(make_pair(block, block + count));
+        }
+        node = m_regions.back().first++;
+        if (m_regions.back().first == m_regions.back().second) {
+            m_regions.pop_back();
+        }
+    }
+    m_live += 1;
+    return new (node) Node(handle);
+}
+Node *NodePool::allocateRun(int count) {
+    if (count == 0) {
+        return nullptr;
+    }
+    m_live += count;
+    return addBlock(count);
+}
+void NodePool::release(Node *node) {
+    node->m_left = m_free;
+    if (m_free == nullptr) {
+        m_lastFree = node;
+    }
+    m_free = node;
+    m_live -= 1;
+    m_holes += 1;
+    if (m_live == 0 && m_capacity > NODEBLOCKMAX) { // nothing points into the blocks anymore
+        clear();
+    }
+}
+// the regions of rhs go first so ours are used up before
+void NodePool::take(NodePool& rhs) {
+    if (&rhs == this) {
+        return;
+    }
+    m_blocks.insert(m_blocks.end(), rhs.m_blocks.begin(), rhs.m_blocks.end());
+    m_regions.insert(m_regions.begin(), rhs.m_regions.begin(), rhs.m_regions.end());
+    if (rhs.m_free != nullptr) {
+        if (m_free == nullptr) {
+            m_free = rhs.m_free;
+        }
+        else {
+            m_lastFree->m_left = rhs.m_free;
+        }
+        m_lastFree = rhs.m_lastFree;
+    }
+    m_capacity += rhs.m_capacity;
+    m_live += rhs.m_live;
+    m_holes += rhs.m_holes;
+    rhs.m_blocks.clear();
+    rhs.m_regions.clear();
+    rhs.m_free = nullptr;
+    rhs.m_lastFree = nullptr;
+    rhs.m_capacity = 0;
+    rhs.m_live = 0;
+    rhs.m_holes = 0;
+}
+void NodePool::reset(int count) {
+    m_free = nullptr;
+    m_lastFree = nullptr;
+    m_live = 0;
+    m_holes = 0;
+    m_regions.clear();
+    if (m_capacity < count) { // one block for everything, the old ones are too small
+        clear();
+        Node *block = addBlock(count);
+        m_regions.push_back(make_pair(block, block + count));
+        return;
+    }
+    for (int i = (int)m_blocks.size() - 1; i >= 0; i--) {
+        m_regions.push_back(make_pair(m_blocks[i].first, m_blocks[i].first + m_blocks[i].second));
+    }
+}
+void NodePool::clear() {
+    for (unsigned int i = 0; i < m_blocks.size(); i++) {
+        ::operator delete(m_blocks[i].first);
+    }
+    m_blocks.clear();
+    m_regions.clear();
+    m_free = nullptr;
+    m_lastFree = nullptr;
+    m_capacity = 0;
+    m_live = 0;
+    m_holes = 0;
+}
+double NodePool::fragmentation() const {
+    if (m_live + m_holes == 0) {
+        return 0;
+    }
+    return (double)m_holes / (m_live + m_holes);
+}
+Node *NodePool::addBlock(int count) {
+    Node *block = static_cast<Node*>(::operator new(sizeof(Node) * count));
+    m_blocks.push_back(make_pair(block, count));
+    m_capacity += count;
+    return block;
+}
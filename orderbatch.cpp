@@ -0,0 +1,97 @@
+#include "cqueue.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+OrderBatch::OrderBatch(const vector<Order>& orders) {
+    reserve((int)orders.size());
+    for (unsigned int i = 0; i < orders.size(); i++) {
+        addOrder(orders[i]);
+    }
+}
+void OrderBatch::addOrder(const Order& order) {
+    m_items.push_back(order.m_item);
+    m_counts.push_back(order.m_count);
+    m_memberships.push_back(order.m_membership);
+    m_points.push_back(order.m_points);
+    m_customerIDs.push_back(order.m_customerID);
+    m_orderIDs.push_back(order.m_orderID);
+}
+Order OrderBatch::getOrder(int index) const {
+    if (index < 0 || index >= size()) {
+        throw out_of_range("no such order in the batch");
+    }
+    return Order(ITEM(m_items[index]), COUNT(m_counts[index]), MEMBERSHIP(m_memberships[index]),
+                 m_points[index], m_customerIDs[index], m_orderIDs[index]);
+}
+void OrderBatch::reserve(int orders) {
+    m_items.reserve(orders);
+    m_counts.reserve(orders);
+    m_memberships.reserve(orders);
+    m_points.reserve(orders);
+    m_customerIDs.reserve(orders);
+    m_orderIDs.reserve(orders);
+}
+void OrderBatch::clear() {
+    m_items.clear();
+    m_counts.clear();
+    m_memberships.clear();
+    m_points.clear();
+    m_customerIDs.clear();
+    m_orderIDs.clear();
+}
+
+// the scalar version, also used for the orders left over after the last full vector
+static void evaluateScalar(const int *itemTier, const int *countTable, int pointsWeight,
+                           const int *items, const int *memberships, const int *counts,
+                           const int *points, int count, int *priorities) {
+    for (int i = 0; i < count; i++) {
+        priorities[i] = itemTier[items[i] * NUMTIERS + memberships[i]] + countTable[counts[i]]
+                        + pointsWeight * points[i];
+    }
+}
+#if defined(__x86_64__) || defined(__i386__)
+// eight orders per step, both table lookups are gathers
+__attribute__((target("avx2")))
+static void evaluateAvx2(const int *itemTier, const int *countTable, int pointsWeight,
+                         const int *items, const int *memberships, const int *counts,
+                         const int *points, int count, int *priorities) {
+    const __m256i tiers = _mm256_set1_epi32(NUMTIERS);
+    const __m256i weight = _mm256_set1_epi32(pointsWeight);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i item = _mm256_loadu_si256((const __m256i*)(items + i));
+        __m256i membership = _mm256_loadu_si256((const __m256i*)(memberships + i));
+        __m256i quantity = _mm256_loadu_si256((const __m256i*)(counts + i));
+        __m256i point = _mm256_loadu_si256((const __m256i*)(points + i));
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(item, tiers), membership);
+        __m256i priority = _mm256_add_epi32(_mm256_i32gather_epi32(itemTier, index, 4),
+                                            _mm256_i32gather_epi32(countTable, quantity, 4));
+        priority = _mm256_add_epi32(priority, _mm256_mullo_epi32(point, weight));
+        _mm256_storeu_si256((__m256i*)(priorities + i), priority);
+    }
+    evaluateScalar(itemTier, countTable, pointsWeight, items + i, memberships + i, counts + i,
+                   points + i, count - i, priorities + i);
+}
+#endif
+void PriorityTable::evaluate(const int *items, const int *memberships, const int *counts, const int *points,
+                             int count, int *priorities) const {
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        evaluateAvx2(m_itemTier, m_count, m_pointsWeight, items, memberships, counts, points, count, priorities);
+        return;
+    }
+#endif
+    evaluateScalar(m_itemTier, m_count, m_pointsWeight, items, memberships, counts, points, count, priorities);
+}
+void PriorityTable::evaluate(const OrderBatch& batch, int first, int count, int *priorities) const {
+    if (first < 0 || count < 0 || first + count > batch.size()) {
+        throw out_of_range("no such orders in the batch");
+    }
+    if (count == 0) {
+        return;
+    }
+    evaluate(&batch.m_items[first], &batch.m_memberships[first], &batch.m_counts[first],
+             &batch.m_points[first], count, priorities);
+}
@@ -0,0 +1,186 @@
+#include "cqueue.h"
+#include <cstring>
+#include <mutex>
+
+OrderStore::Block **OrderStore::m_pages[ORDERPAGES];
+// block numbers are handed out and taken back under one lock, a store only
+// asks for one per ORDERBLOCK orders
+static mutex directoryLock;
+static unsigned int nextBlock = 0;
+// never destroyed, queues with static storage still release blocks at exit
+static vector<unsigned int>& freeBlocks = *new vector<unsigned int>();
+
+OrderStore::OrderStore() : m_freeSlots(0) {}
+OrderStore::~OrderStore() {
+    clear();
+}
+unsigned int OrderStore::add(const Order& order, long long epoch) {
+    if (m_open.empty()) {
+        addBlock();
+    }
+    Block *b = block(m_open.back() << ORDERBLOCKBITS);
+    unsigned int handle = b->m_free;
+    int slot = handle & (ORDERBLOCK - 1);
+    b->m_free = b->m_next[slot];
+    b->m_used += 1;
+    m_freeSlots -= 1;
+    if (b->m_free == NOORDER) {
+        m_open.pop_back();
+        b->m_openIndex = -1;
+    }
+    b->m_items[slot] = (unsigned char)order.m_item;
+    b->m_memberships[slot] = (unsigned char)order.m_membership;
+    b->m_counts[slot] = (unsigned char)order.m_count;
+    b->m_points[slot] = order.m_points;
+    b->m_customerIDs[slot] = order.m_customerID;
+    b->m_orderIDs[slot] = order.m_orderID;
+    b->m_epochs[slot] = epoch;
+    return handle;
+}
+// A block that was full is filled next, starting with the slot just freed.
+// An empty block is dropped once the other open blocks have half a block
+// of room left without it, so a store that hovers at a block boundary
+// doesn't allocate and drop the same block over and over.
+void OrderStore::remove(unsigned int handle) {
+    Block *b = block(handle);
+    if (b->m_free == NOORDER) {
+        b->m_openIndex = (int)m_open.size();
+        m_open.push_back(handle >> ORDERBLOCKBITS);
+    }
+    b->m_next[handle & (ORDERBLOCK - 1)] = b->m_free;
+    b->m_free = handle;
+    b->m_used -= 1;
+    m_freeSlots += 1;
+    if (b->m_used == 0 && m_freeSlots - ORDERBLOCK >= ORDERBLOCK / 2) {
+        dropBlock(b);
+    }
+}
+// the open blocks of rhs go first so ours are filled before
+void OrderStore::take(OrderStore& rhs) {
+    if (&rhs == this) {
+        return;
+    }
+    for (unsigned int i = 0; i < rhs.m_blocks.size(); i++) {
+        block(rhs.m_blocks[i] << ORDERBLOCKBITS)->m_index = (int)m_blocks.size();
+        m_blocks.push_back(rhs.m_blocks[i]);
+    }
+    m_open.insert(m_open.begin(), rhs.m_open.begin(), rhs.m_open.end());
+    for (unsigned int i = 0; i < m_open.size(); i++) {
+        block(m_open[i] << ORDERBLOCKBITS)->m_openIndex = (int)i;
+    }
+    m_freeSlots += rhs.m_freeSlots;
+    rhs.m_blocks.clear();
+    rhs.m_open.clear();
+    rhs.m_freeSlots = 0;
+}
+// Block i of the copy holds the copies of the orders in block i of rhs, at
+// the same slots, so translating a handle is a lookup of the block's index.
+// The free chains stay within their block and only need the new number.
+void OrderStore::copy(const OrderStore& rhs) {
+    if (&rhs == this) {
+        return;
+    }
+    clear();
+    for (unsigned int i = 0; i < rhs.m_blocks.size(); i++) {
+        unsigned int number = allocateBlock();
+        Block *b = block(number << ORDERBLOCKBITS);
+        memcpy(b, block(rhs.m_blocks[i] << ORDERBLOCKBITS), sizeof(Block));
+        b->m_index = (int)i;
+        m_blocks.push_back(number);
+        unsigned int first = number << ORDERBLOCKBITS;
+        for (unsigned int *link = &b->m_free; *link != NOORDER; link = &b->m_next[*link & (ORDERBLOCK - 1)]) {
+            *link = first | (*link & (ORDERBLOCK - 1));
+        }
+    }
+    for (unsigned int i = 0; i < rhs.m_open.size(); i++) {
+        m_open.push_back(copied(rhs.m_open[i] << ORDERBLOCKBITS) >> ORDERBLOCKBITS);
+    }
+    m_freeSlots = rhs.m_freeSlots;
+}
+// the block of an rhs handle knows its position in rhs
+unsigned int OrderStore::copied(unsigned int handle) const {
+    return (m_blocks[block(handle)->m_index] << ORDERBLOCKBITS) | (handle & (ORDERBLOCK - 1));
+}
+void OrderStore::clear() {
+    for (unsigned int i = 0; i < m_blocks.size(); i++) {
+        releaseBlock(m_blocks[i]);
+    }
+    m_blocks.clear();
+    m_open.clear();
+    m_freeSlots = 0;
+}
+Order OrderStore::get(unsigned int handle) {
+    const Block *b = block(handle);
+    int slot = handle & (ORDERBLOCK - 1);
+    return Order(ITEM(b->m_items[slot]), COUNT(b->m_counts[slot]), MEMBERSHIP(b->m_memberships[slot]),
+                 b->m_points[slot], b->m_customerIDs[slot], b->m_orderIDs[slot]);
+}
+void OrderStore::prefetch(unsigned int handle) {
+    const Block *b = block(handle);
+    int slot = handle & (ORDERBLOCK - 1);
+    __builtin_prefetch(&b->m_items[slot]);
+    __builtin_prefetch(&b->m_memberships[slot]);
+    __builtin_prefetch(&b->m_counts[slot]);
+    __builtin_prefetch(&b->m_points[slot]);
+    __builtin_prefetch(&b->m_customerIDs[slot]);
+    __builtin_prefetch(&b->m_orderIDs[slot]);
+}
+void OrderStore::addBlock() {
+    unsigned int number = allocateBlock();
+    Block *b = block(number << ORDERBLOCKBITS);
+    b->m_index = (int)m_blocks.size();
+    m_blocks.push_back(number);
+    unsigned int first = number << ORDERBLOCKBITS;
+    for (int slot = 0; slot < ORDERBLOCK - 1; slot++) {
+        b->m_next[slot] = first + slot + 1;
+    }
+    b->m_next[ORDERBLOCK - 1] = NOORDER;
+    b->m_free = first;
+    b->m_used = 0;
+    b->m_openIndex = (int)m_open.size();
+    m_open.push_back(number);
+    m_freeSlots += ORDERBLOCK;
+}
+// swapped out of both lists by the last entry of each
+void OrderStore::dropBlock(Block *b) {
+    unsigned int number = m_blocks[b->m_index];
+    unsigned int lastOpen = m_open.back();
+    m_open[b->m_openIndex] = lastOpen;
+    block(lastOpen << ORDERBLOCKBITS)->m_openIndex = b->m_openIndex;
+    m_open.pop_back();
+    unsigned int last = m_blocks.back();
+    m_blocks[b->m_index] = last;
+    block(last << ORDERBLOCKBITS)->m_index = b->m_index;
+    m_blocks.pop_back();
+    m_freeSlots -= ORDERBLOCK;
+    releaseBlock(number);
+}
+// The last handle of the last block would be NOORDER, so that block is
+// never handed out.
+unsigned int OrderStore::allocateBlock() {
+    lock_guard<mutex> guard(directoryLock);
+    unsigned int number;
+    if (!freeBlocks.empty()) {
+        number = freeBlocks.back();
+        freeBlocks.pop_back();
+    }
+    else {
+        if (nextBlock == ((NOORDER >> ORDERBLOCKBITS))) {
+            throw overflow_error("too many orders for the order store");
+        }
+        number = nextBlock++;
+    }
+    Block **&page = m_pages[number >> ORDERBLOCKBITS];
+    if (page == nullptr) {
+        page = new Block*[ORDERBLOCK]();
+    }
+    page[number & (ORDERBLOCK - 1)] = new Block;
+    return number;
+}
+void OrderStore::releaseBlock(unsigned int number) {
+    lock_guard<mutex> guard(directoryLock);
+    Block *&b = m_pages[number >> ORDERBLOCKBITS][number & (ORDERBLOCK - 1)];
+    delete b;
+    b = nullptr;
+    freeBlocks.push_back(number);
+}
@@ -0,0 +1,125 @@
+#include "partitionedcqueue.h"
+
+PartitionedCQueue::PartitionedCQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure, int stations)
+    : m_heapType(heapType) {
+    if (stations < 1) {
+        throw out_of_range("a partitioned queue needs at least one station");
+    }
+    for (int i = 0; i < NUMITEMS; i++) {
+        m_partitions.push_back(new Partition(priFn, heapType, structure));
+        m_owner[i] = i % stations;
+    }
+    for (int i = 0; i < stations; i++) {
+        m_stations.push_back(new Station());
+    }
+}
+PartitionedCQueue::~PartitionedCQueue() {
+    for (unsigned int i = 0; i < m_partitions.size(); i++) {
+        delete m_partitions[i];
+    }
+    for (unsigned int i = 0; i < m_stations.size(); i++) {
+        delete m_stations[i];
+    }
+}
+void PartitionedCQueue::assignItem(ITEM item, int station) {
+    if (item < 0 || item >= NUMITEMS || station < 0 || station >= numStations()) {
+        throw out_of_range("no such item or station");
+    }
+    m_owner[item] = station;
+}
+int PartitionedCQueue::getStation(ITEM item) const {
+    if (item < 0 || item >= NUMITEMS) {
+        throw out_of_range("no such item");
+    }
+    return m_owner[item];
+}
+int PartitionedCQueue::numStations() const {
+    return (int)m_stations.size();
+}
+ADMISSION PartitionedCQueue::insertOrder(const Order& order) {
+    if (order.getItem() < 0 || order.getItem() >= NUMITEMS) {
+        return INVALIDID;
+    }
+    Partition& partition = *m_partitions[order.getItem()];
+    lock_guard<mutex> guard(partition.m_lock);
+    ADMISSION status = partition.m_queue.insertOrder(order);
+    publish(partition);
+    return status;
+}
+bool PartitionedCQueue::getNextOrder(int station, Order& order) {
+    if (station < 0 || station >= numStations()) {
+        throw out_of_range("no such station");
+    }
+    // Picks the best partition from the summaries and retries if another
+    // station emptied it in the meantime. Own partitions are tried first.
+    for (int pass = 0; pass < 2; pass++) {
+        bool stealing = (pass == 1);
+        while (true) {
+            int best = -1;
+            long long bestTop = EMPTYPARTITION;
+            for (int i = 0; i < NUMITEMS; i++) {
+                if ((m_owner[i] == station) == stealing) {
+                    continue;
+                }
+                long long top = m_partitions[i]->m_top.load(memory_order_acquire);
+                if (top < bestTop) {
+                    bestTop = top;
+                    best = i;
+                }
+            }
+            if (best == -1) {
+                break; // nothing left for this pass
+            }
+            if (popFrom(best, order)) {
+                if (stealing) {
+                    m_stations[station]->m_stolen.fetch_add(1, memory_order_relaxed);
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
+int PartitionedCQueue::numOrders() const {
+    int total = 0;
+    for (int i = 0; i < NUMITEMS; i++) {
+        total += numOrders(ITEM(i));
+    }
+    return total;
+}
+int PartitionedCQueue::numOrders(ITEM item) const {
+    if (item < 0 || item >= NUMITEMS) {
+        throw out_of_range("no such item");
+    }
+    lock_guard<mutex> guard(m_partitions[item]->m_lock);
+    return m_partitions[item]->m_queue.numOrders();
+}
+unsigned long long PartitionedCQueue::stolen(int station) const {
+    if (station < 0 || station >= numStations()) {
+        throw out_of_range("no such station");
+    }
+    return m_stations[station]->m_stolen.load(memory_order_relaxed);
+}
+bool PartitionedCQueue::popFrom(int item, Order& order) {
+    Partition& partition = *m_partitions[item];
+    lock_guard<mutex> guard(partition.m_lock);
+    if (partition.m_queue.numOrders() == 0) {
+        return false; // emptied after we read the summary
+    }
+    order = partition.m_queue.getNextOrder();
+    publish(partition);
+    return true;
+}
+// The summary is normalised so that smaller is always better. With curve
+// aging each partition re-keys on its own, so keys compare as of the last
+// re-key of each partition.
+void PartitionedCQueue::publish(Partition& partition) {
+    long long top = EMPTYPARTITION;
+    if (partition.m_queue.numOrders() > 0) {
+        top = partition.m_queue.getTopKey();
+        if (m_heapType == MAXHEAP) {
+            top = -top;
+        }
+    }
+    partition.m_top.store(top, memory_order_release);
+}
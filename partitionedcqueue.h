@@ -0,0 +1,54 @@
+#ifndef PARTITIONEDCQUEUE_H
+#define PARTITIONEDCQUEUE_H
+#include "cqueue.h"
+#include <atomic>
+#include <climits>
+#include <mutex>
+
+const long long EMPTYPARTITION = LLONG_MAX; // root summary of an empty partition
+
+class PartitionedCQueue{
+    // One CQueue per ITEM, each with its own lock, so stations that make
+    // different items never touch the same root. A station pops from the
+    // partitions it owns and only steals when all of them are empty. Each
+    // partition publishes its root key in an atomic summary, which lets a
+    // thief pick the best victim without taking any lock.
+public:
+    // items are dealt round robin, item i belongs to station i % stations
+    PartitionedCQueue(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure, int stations);
+    ~PartitionedCQueue();
+    PartitionedCQueue(const PartitionedCQueue&) = delete;
+    PartitionedCQueue& operator=(const PartitionedCQueue&) = delete;
+    void assignItem(ITEM item, int station); // not safe while stations pop
+    int getStation(ITEM item) const;
+    int numStations() const;
+    ADMISSION insertOrder(const Order& order); // INVALIDID for an unknown item
+    // Pops the best order among the station's own partitions, or steals the
+    // best order of the whole queue if they are empty. Returns false if no
+    // order was found.
+    bool getNextOrder(int station, Order& order);
+    int numOrders() const;
+    int numOrders(ITEM item) const;
+    unsigned long long stolen(int station) const; // orders the station stole
+
+private:
+    struct alignas(64) Partition{ // own cache line, partitions are hit by different threads
+        Partition(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure)
+            : m_queue(priFn, heapType, structure), m_top(EMPTYPARTITION) {}
+        CQueue m_queue;
+        mutable mutex m_lock;      // guards m_queue
+        atomic<long long> m_top;   // root key, smaller is better, EMPTYPARTITION if empty
+    };
+    struct alignas(64) Station{
+        Station() : m_stolen(0) {}
+        atomic<unsigned long long> m_stolen;
+    };
+    HEAPTYPE m_heapType;
+    int m_owner[NUMITEMS];         // station that owns each item
+    vector<Partition*> m_partitions;
+    vector<Station*> m_stations;
+
+    bool popFrom(int item, Order& order); // false if the partition was empty
+    void publish(Partition& partition);   // call with the partition lock held
+};
+#endif
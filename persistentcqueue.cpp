@@ -0,0 +1,205 @@
+#include "persistentcqueue.h"
+
+PersistentCQueue::PersistentCQueue(prifn_t priFn, HEAPTYPE heapType)
+    : m_root(nullptr), m_size(0), m_priorFunc(priFn), m_heapType(heapType), m_sequence(0) {}
+PersistentCQueue::~PersistentCQueue() {
+    release(m_root);
+}
+PersistentCQueue::PersistentCQueue(const PersistentCQueue& rhs)
+    : m_root(retain(rhs.m_root)), m_size(rhs.m_size), m_priorFunc(rhs.m_priorFunc),
+      m_heapType(rhs.m_heapType), m_sequence(rhs.m_sequence) {}
+PersistentCQueue& PersistentCQueue::operator=(const PersistentCQueue& rhs) {
+    if (&rhs != this) {
+        PersistentNode *old = m_root;
+        m_root = retain(rhs.m_root);
+        release(old); // after the retain, rhs may share it
+        m_size = rhs.m_size;
+        m_priorFunc = rhs.m_priorFunc;
+        m_heapType = rhs.m_heapType;
+        m_sequence = rhs.m_sequence;
+    }
+    return *this;
+}
+ADMISSION PersistentCQueue::insertOrder(const Order& order) {
+    if (order.getCustomerID() < MINCUSTID || order.getCustomerID() > MAXCUSTID ||
+        order.getOrderID() < MINORDERID || order.getOrderID() > MAXORDERID) {
+        return INVALIDID;
+    }
+    long long key = m_priorFunc(order);
+    PersistentNode *node = new PersistentNode(order, m_heapType == MINHEAP ? key : -key, m_sequence++);
+    m_root = meld(m_root, node);
+    m_size += 1;
+    return ADMITTED;
+}
+// a root only this queue holds is freed, a shared one stays for the others
+// and its children get a reference from the new heap
+Order PersistentCQueue::getNextOrder() {
+    if (m_size == 0) {
+        throw out_of_range("the queue is empty");
+    }
+    PersistentNode *root = m_root;
+    Order order = root->m_order;
+    PersistentNode *left = root->m_left;
+    PersistentNode *right = root->m_right;
+    if (root->m_refs.load(memory_order_acquire) == 1) {
+        root->m_left = nullptr; // the references move to the melded heap
+        root->m_right = nullptr;
+        delete root;
+    }
+    else {
+        retain(left);
+        retain(right);
+        release(root);
+    }
+    m_root = meld(left, right);
+    m_size -= 1;
+    return order;
+}
+const Order& PersistentCQueue::getTopOrder() const {
+    if (m_size == 0) {
+        throw out_of_range("the queue is empty");
+    }
+    return m_root->m_order;
+}
+void PersistentCQueue::mergeWithQueue(PersistentCQueue& rhs) {
+    if (m_priorFunc != rhs.m_priorFunc || m_heapType != rhs.m_heapType) {
+        throw domain_error("the priority function or the heap type aren't the same");
+    }
+    if (&rhs == this) {
+        return;
+    }
+    // ties between the two queues go by their own sequence numbers
+    if (rhs.m_sequence > m_sequence) {
+        m_sequence = rhs.m_sequence;
+    }
+    m_root = meld(m_root, rhs.m_root);
+    m_size += rhs.m_size;
+    rhs.m_root = nullptr;
+    rhs.m_size = 0;
+}
+vector<Order> PersistentCQueue::getOrders() const {
+    vector<Order> orders;
+    orders.reserve(m_size);
+    vector<const PersistentNode*> stack;
+    if (m_root != nullptr) {
+        stack.push_back(m_root);
+    }
+    while (!stack.empty()) {
+        const PersistentNode *curr = stack.back();
+        stack.pop_back();
+        orders.push_back(curr->m_order);
+        if (curr->m_right != nullptr) {
+            stack.push_back(curr->m_right);
+        }
+        if (curr->m_left != nullptr) {
+            stack.push_back(curr->m_left);
+        }
+    }
+    return orders;
+}
+void PersistentCQueue::clear() {
+    release(m_root);
+    m_root = nullptr;
+    m_size = 0;
+}
+int PersistentCQueue::numOrders() const {
+    return m_size;
+}
+prifn_t PersistentCQueue::getPriorityFn() const {
+    return m_priorFunc;
+}
+HEAPTYPE PersistentCQueue::getHeapType() const {
+    return m_heapType;
+}
+// same format as CQueue::dump for a leftist heap
+void PersistentCQueue::dump() const {
+    if (m_size == 0) {
+        cout << "Empty heap.\n";
+    }
+    vector<pair<const PersistentNode*, int> > stack;
+    if (m_root != nullptr) {
+        stack.push_back(make_pair(m_root, 0));
+    }
+    while (!stack.empty()) {
+        const PersistentNode *pos = stack.back().first;
+        int visit = stack.back().second;
+        stack.pop_back();
+        if (visit == 0) {
+            cout << "(";
+            stack.push_back(make_pair(pos, 1));
+            if (pos->m_left != nullptr) {
+                stack.push_back(make_pair(pos->m_left, 0));
+            }
+        }
+        else if (visit == 1) {
+            cout << m_priorFunc(pos->m_order) << ":" << pos->m_order.getOrderID() << ":" << pos->m_npl;
+            stack.push_back(make_pair(pos, 2));
+            if (pos->m_right != nullptr) {
+                stack.push_back(make_pair(pos->m_right, 0));
+            }
+        }
+        else {
+            cout << ")";
+        }
+    }
+    cout << endl;
+}
+PersistentCQueue::PersistentNode *PersistentCQueue::retain(PersistentNode *node) {
+    if (node != nullptr) {
+        node->m_refs.fetch_add(1, memory_order_relaxed);
+    }
+    return node;
+}
+// with an explicit stack, a leftist heap can be deep on the left
+void PersistentCQueue::release(PersistentNode *node) {
+    vector<PersistentNode*> stack;
+    if (node != nullptr) {
+        stack.push_back(node);
+    }
+    while (!stack.empty()) {
+        node = stack.back();
+        stack.pop_back();
+        if (node->m_refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+            if (node->m_left != nullptr) {
+                stack.push_back(node->m_left);
+            }
+            if (node->m_right != nullptr) {
+                stack.push_back(node->m_right);
+            }
+            delete node;
+        }
+    }
+}
+// Leftist merge down the right spines. The winner is reused if nothing else
+// references it, else it is copied: the copy takes a new reference to the
+// left child and the old right child goes down the merge with one, so the
+// merge below sees it as shared and copies it in turn. The recursion is as
+// deep as the two right spines, which are logarithmic.
+PersistentCQueue::PersistentNode *PersistentCQueue::meld(PersistentNode *curr, PersistentNode *temp) {
+    if (curr == nullptr) {
+        return temp;
+    }
+    if (temp == nullptr) {
+        return curr;
+    }
+    if (curr->m_key > temp->m_key || (curr->m_key == temp->m_key && curr->m_sequence > temp->m_sequence)) {
+        PersistentNode *swapped = curr;
+        curr = temp;
+        temp = swapped;
+    }
+    PersistentNode *winner = curr;
+    if (curr->m_refs.load(memory_order_acquire) != 1) {
+        winner = new PersistentNode(curr->m_order, curr->m_key, curr->m_sequence);
+        winner->m_left = retain(curr->m_left);
+        winner->m_right = retain(curr->m_right);
+        release(curr);
+    }
+    winner->m_right = meld(winner->m_right, temp);
+    if (winner->m_left == nullptr || winner->m_left->m_npl < winner->m_right->m_npl) {
+        PersistentNode *swapped = winner->m_left;
+        winner->m_left = winner->m_right;
+        winner->m_right = swapped;
+    }
+    winner->m_npl = winner->m_right == nullptr ? 0 : winner->m_right->m_npl + 1;
+    return winner;
+}
@@ -0,0 +1,57 @@
+#ifndef PERSISTENTCQUEUE_H
+#define PERSISTENTCQUEUE_H
+#include "cqueue.h"
+#include <atomic>
+
+class PersistentCQueue{
+    // A leftist heap whose nodes are shared between copies, so copying a
+    // queue is O(1). Nodes are reference counted. A node only one queue can
+    // reach is changed in place like in CQueue, a shared one is copied
+    // first, so a merge copies at most the right spines it walks, which are
+    // logarithmic. A copy is a snapshot: it never sees later changes of the
+    // original and can be read or drained on another thread while the
+    // original keeps changing, without locks. Taking the copy itself must
+    // not race with a change of the original, like any copy.
+public:
+    friend class Tester; // for testing purposes
+    PersistentCQueue(prifn_t priFn, HEAPTYPE heapType);
+    ~PersistentCQueue();
+    PersistentCQueue(const PersistentCQueue& rhs);             // O(1)
+    PersistentCQueue& operator=(const PersistentCQueue& rhs);  // O(1) plus releasing the old heap
+    ADMISSION insertOrder(const Order& order); // ADMITTED or INVALIDID
+    Order getNextOrder();        // throws out_of_range when empty
+    const Order& getTopOrder() const; // the next order without removing it, throws when empty
+    // takes all orders of rhs, throws domain_error if the priority function
+    // or the heap type differ. Orders rhs shares with a copy are not copied.
+    void mergeWithQueue(PersistentCQueue& rhs);
+    vector<Order> getOrders() const; // all orders in preorder, for reports
+    void clear();
+    int numOrders() const;
+    prifn_t getPriorityFn() const;
+    HEAPTYPE getHeapType() const;
+    void dump() const; // For debugging purposes
+
+private:
+    struct PersistentNode{
+        PersistentNode(const Order& order, long long key, unsigned long long sequence)
+            : m_order(order), m_key(key), m_sequence(sequence), m_npl(0),
+              m_left(nullptr), m_right(nullptr), m_refs(1) {}
+        Order m_order;
+        long long m_key;             // priority, negated for a MAXHEAP so smaller is better
+        unsigned long long m_sequence; // insertion sequence, breaks ties first in first out
+        int m_npl;
+        PersistentNode *m_left;      // the node holds a reference to each child
+        PersistentNode *m_right;
+        atomic<int> m_refs;          // parents and queues pointing here
+    };
+    PersistentNode *m_root;   // the queue holds a reference to it
+    int m_size;
+    prifn_t m_priorFunc;
+    HEAPTYPE m_heapType;
+    unsigned long long m_sequence; // sequence of the next order
+
+    static PersistentNode *retain(PersistentNode *node);
+    static void release(PersistentNode *node); // frees what is no longer referenced
+    static PersistentNode *meld(PersistentNode *curr, PersistentNode *temp); // takes a reference of each
+};
+#endif
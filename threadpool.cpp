@@ -0,0 +1,108 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int workers) {
+    m_job = nullptr;
+    m_tasks = 0;
+    m_next = 0;
+    m_finished = 0;
+    m_stop = false;
+    start(workers);
+}
+ThreadPool::~ThreadPool() {
+    stop();
+}
+int ThreadPool::size() const {
+    return (int)m_workers.size() + 1;
+}
+void ThreadPool::resize(int workers) {
+    lock_guard<mutex> guard(m_submit);
+    stop();
+    start(workers);
+}
+void ThreadPool::start(int workers) {
+    m_stop = false;
+    for (int i = 0; i < workers; i++) {
+        m_workers.push_back(thread(&ThreadPool::work, this));
+    }
+}
+void ThreadPool::stop() {
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (unsigned int i = 0; i < m_workers.size(); i++) {
+        m_workers[i].join();
+    }
+    m_workers.clear();
+}
+void ThreadPool::parallelFor(int tasks, const function<void(int)>& job) {
+    if (tasks <= 0) {
+        return;
+    }
+    if (tasks == 1 || m_workers.empty()) { // nothing to share
+        for (int i = 0; i < tasks; i++) {
+            job(i);
+        }
+        return;
+    }
+    lock_guard<mutex> submit(m_submit);
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_job = &job;
+        m_tasks = tasks;
+        m_next = 0;
+        m_finished = 0;
+        m_error = nullptr;
+    }
+    m_wake.notify_all();
+    runTasks();
+    unique_lock<mutex> guard(m_lock);
+    m_done.wait(guard, [this] {return m_finished == m_tasks;});
+    m_job = nullptr;
+    exception_ptr error = m_error;
+    m_error = nullptr;
+    guard.unlock();
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+void ThreadPool::runTasks() {
+    unique_lock<mutex> guard(m_lock);
+    while (m_job != nullptr && m_next < m_tasks) {
+        const function<void(int)> *job = m_job;
+        int task = m_next++;
+        guard.unlock();
+        exception_ptr error;
+        try {
+            (*job)(task);
+        }
+        catch (...) {
+            error = current_exception();
+        }
+        guard.lock();
+        if (error && !m_error) {
+            m_error = error;
+        }
+        m_finished += 1;
+        if (m_finished == m_tasks) {
+            m_done.notify_all();
+        }
+    }
+}
+void ThreadPool::work() {
+    unique_lock<mutex> guard(m_lock);
+    while (true) {
+        m_wake.wait(guard, [this] {return m_stop || (m_job != nullptr && m_next < m_tasks);});
+        if (m_stop) {
+            return;
+        }
+        guard.unlock();
+        runTasks();
+        guard.lock();
+    }
+}
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(thread::hardware_concurrency() > 1 ? thread::hardware_concurrency() - 1 : 0);
+    return pool;
+}
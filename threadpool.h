@@ -0,0 +1,46 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+class ThreadPool{
+    // a small fixed set of worker threads that run one parallelFor at a time,
+    // the calling thread helps with the tasks while it waits for them
+public:
+    explicit ThreadPool(int workers);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    int size() const; // threads taking part in a parallelFor, the caller included
+    void resize(int workers);
+    // Runs job(0) .. job(tasks - 1) and returns when all of them are done.
+    // The first exception thrown by a task is rethrown here. Must not be
+    // called from inside a task of the same pool.
+    void parallelFor(int tasks, const function<void(int)>& job);
+    // the pool shared by the library, one thread per core
+    static ThreadPool& shared();
+
+private:
+    void work();      // worker thread loop
+    void runTasks();  // claims and runs tasks until none are left
+    void start(int workers);
+    void stop();
+
+    vector<thread> m_workers;
+    mutex m_submit;                  // one parallelFor at a time
+    mutex m_lock;                    // guards everything below
+    condition_variable m_wake;       // a job was posted or the pool stops
+    condition_variable m_done;       // the last task of a job finished
+    const function<void(int)> *m_job;
+    int m_tasks;                     // tasks in the current job
+    int m_next;                      // next task to claim
+    int m_finished;                  // tasks completed
+    exception_ptr m_error;
+    bool m_stop;
+};
+#endif
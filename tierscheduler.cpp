@@ -0,0 +1,109 @@
+#include "tierscheduler.h"
+
+TierScheduler::TierScheduler(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure) {
+    for (int t = 0; t < NUMTIERS; t++) {
+        m_queues.push_back(CQueue(priFn, heapType, structure));
+        m_weights[t] = 1;
+        m_finish[t] = 0;
+        m_dispatched[t] = 0;
+    }
+    m_virtualTime = 0;
+    m_size = 0;
+    m_activeCount = 0;
+}
+void TierScheduler::setWeight(MEMBERSHIP tier, int weight) {
+    if (weight < 1 || weight > MAXTIERWEIGHT) {
+        throw out_of_range("the tier weight is out of range");
+    }
+    m_weights[helpTier(tier)] = weight;
+}
+int TierScheduler::getWeight(MEMBERSHIP tier) const {
+    return m_weights[helpTier(tier)];
+}
+// the membership indexes the tiers, so it is checked like the IDs
+ADMISSION TierScheduler::insertOrder(const Order& order) {
+    int tier = order.getMemebership();
+    if (tier < 0 || tier >= NUMTIERS) {
+        return INVALIDID;
+    }
+    CQueue& queue = m_queues[tier];
+    int before = queue.numOrders();
+    ADMISSION status = queue.insertOrder(order);
+    if (status != ADMITTED) { // dropped by the queue
+        return status;
+    }
+    m_size += 1;
+    if (before == 0) {
+        // a tier that was idle starts from the current virtual time, it
+        // does not get credit for the time it had nothing to send
+        if (m_finish[tier] < m_virtualTime) {
+            m_finish[tier] = m_virtualTime;
+        }
+        m_finish[tier] += MAXTIERWEIGHT / m_weights[tier];
+        m_active[m_activeCount] = tier;
+        m_activeCount += 1;
+        helpSiftUp(m_activeCount - 1);
+    }
+    return ADMITTED;
+}
+Order TierScheduler::getNextOrder() {
+    if (m_activeCount == 0) {
+        throw out_of_range("the queue is empty");
+    }
+    int tier = m_active[0];
+    Order order = m_queues[tier].getNextOrder();
+    m_size -= 1;
+    m_dispatched[tier] += 1;
+    m_virtualTime = m_finish[tier];
+    if (m_queues[tier].numOrders() > 0) {
+        m_finish[tier] += MAXTIERWEIGHT / m_weights[tier];
+    } else {
+        m_activeCount -= 1;
+        m_active[0] = m_active[m_activeCount];
+    }
+    helpSiftDown(0);
+    return order;
+}
+int TierScheduler::numOrders() const {
+    return m_size;
+}
+int TierScheduler::numOrders(MEMBERSHIP tier) const {
+    return m_queues[helpTier(tier)].numOrders();
+}
+unsigned long long TierScheduler::dispatched(MEMBERSHIP tier) const {
+    return m_dispatched[helpTier(tier)];
+}
+int TierScheduler::helpTier(MEMBERSHIP tier) {
+    if (tier < 0 || tier >= NUMTIERS) {
+        throw out_of_range("no such tier");
+    }
+    return tier;
+}
+// ties go to the higher tier
+bool TierScheduler::helpEarlier(int tierA, int tierB) const {
+    return m_finish[tierA] < m_finish[tierB] || (m_finish[tierA] == m_finish[tierB] && tierA < tierB);
+}
+void TierScheduler::helpSiftUp(int index) {
+    while (index > 0 && helpEarlier(m_active[index], m_active[(index - 1) / 2])) {
+        swap(m_active[index], m_active[(index - 1) / 2]);
+        index = (index - 1) / 2;
+    }
+}
+void TierScheduler::helpSiftDown(int index) {
+    while (true) {
+        int first = index;
+        int left = 2 * index + 1;
+        int right = 2 * index + 2;
+        if (left < m_activeCount && helpEarlier(m_active[left], m_active[first])) {
+            first = left;
+        }
+        if (right < m_activeCount && helpEarlier(m_active[right], m_active[first])) {
+            first = right;
+        }
+        if (first == index) {
+            return;
+        }
+        swap(m_active[index], m_active[first]);
+        index = first;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef TIERSCHEDULER_H
+#define TIERSCHEDULER_H
+#include "cqueue.h"
+const int MAXTIERWEIGHT = 720720;  // every weight up to 16 divides it
+
+class TierScheduler{
+    // One CQueue per MEMBERSHIP tier served by weighted fair queuing: every
+    // order dispatched from a tier pushes its virtual finish time forward by
+    // MAXTIERWEIGHT / weight, and the tier with the earliest finish time goes
+    // next. Over time a tier gets its weight's share of the dispatches and
+    // no tier starves. Inside a tier orders leave in priority order.
+public:
+    TierScheduler(prifn_t priFn, HEAPTYPE heapType, STRUCTURE structure);
+    // relative share of a tier, 1 .. MAXTIERWEIGHT, the default is 1
+    void setWeight(MEMBERSHIP tier, int weight);
+    int getWeight(MEMBERSHIP tier) const;
+    // like CQueue::insertOrder, an order whose membership is not a tier is INVALIDID
+    ADMISSION insertOrder(const Order& order);
+    Order getNextOrder();     // throws out_of_range when every tier is empty
+    int numOrders() const;
+    int numOrders(MEMBERSHIP tier) const;
+    unsigned long long dispatched(MEMBERSHIP tier) const; // orders served per tier
+    // the tier accessors throw out_of_range for a tier that does not exist
+
+private:
+    vector<CQueue> m_queues;
+    int m_weights[NUMTIERS];
+    unsigned long long m_finish[NUMTIERS];  // finish time of the tier's next order
+    unsigned long long m_virtualTime;       // finish time of the last order served
+    unsigned long long m_dispatched[NUMTIERS];
+    int m_size;
+    // binary heap of the backlogged tiers ordered by finish time, so picking
+    // the next tier is O(log T)
+    int m_active[NUMTIERS];
+    int m_activeCount;
+
+    static int helpTier(MEMBERSHIP tier); // throws out_of_range
+    bool helpEarlier(int tierA, int tierB) const;
+    void helpSiftUp(int index);
+    void helpSiftDown(int index);
+};
+#endif
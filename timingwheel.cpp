@@ -0,0 +1,189 @@
+#include "timingwheel.h"
+const int OVERFLOWSLOT = WHEELLEVELS * WHEELSLOTS;
+const int FREESLOT = -1;
+
+TimingWheel::TimingWheel(CQueue& queue, long long now)
+    : m_queue(queue), m_now(now), m_pending(0), m_free(-1) {
+    for (int i = 0; i <= OVERFLOWSLOT; i++) {
+        m_heads[i] = -1;
+    }
+    for (int l = 0; l < WHEELLEVELS; l++) {
+        m_occupied[l] = 0;
+    }
+}
+TimingWheel::~TimingWheel() {
+    for (unsigned int i = 0; i < m_entries.size(); i++) {
+        if (m_entries[i].m_slot != FREESLOT) {
+            m_queue.withdraw(m_entries[i].m_order);
+        }
+    }
+}
+ADMISSION TimingWheel::schedule(const Order& order, long long due, long long& handle) {
+    handle = NOHANDLE;
+    if (due <= m_now) {
+        return m_queue.insertOrder(order);
+    }
+    ADMISSION status = m_queue.admit(order); // the order counts against its customer while it waits
+    if (status != ADMITTED) {
+        return status;
+    }
+    int entry = m_free;
+    if (entry == -1) {
+        entry = (int)m_entries.size();
+        m_entries.push_back(Entry());
+        m_entries[entry].m_generation = 0;
+    }
+    else {
+        m_free = m_entries[entry].m_next;
+    }
+    m_entries[entry].m_order = order;
+    m_entries[entry].m_due = due;
+    place(entry);
+    m_pending += 1;
+    handle = ((long long)m_entries[entry].m_generation << 32) | entry;
+    return ADMITTED;
+}
+bool TimingWheel::cancel(long long handle) {
+    int entry = (int)(handle & 0xffffffffLL);
+    if (handle < 0 || entry >= (int)m_entries.size() ||
+        m_entries[entry].m_slot == FREESLOT ||
+        m_entries[entry].m_generation != (unsigned int)(handle >> 32)) {
+        return false;
+    }
+    unlink(entry);
+    m_queue.withdraw(m_entries[entry].m_order);
+    release(entry);
+    m_pending -= 1;
+    return true;
+}
+int TimingWheel::advance(long long ticks) {
+    return advanceTo(m_now + ticks);
+}
+// Jumps from event to event. At each one the higher levels are cascaded
+// first so their orders can still land in the level 0 slot of that tick.
+int TimingWheel::advanceTo(long long time) {
+    vector<Order> due;
+    while (m_pending > 0) {
+        long long next = nextEvent();
+        if (next > time) {
+            break;
+        }
+        m_now = next;
+        if ((m_now & ((1LL << (WHEELBITS * WHEELLEVELS)) - 1)) == 0) {
+            int entry = takeSlot(OVERFLOWSLOT); // the next top level block started
+            while (entry != -1) {
+                int following = m_entries[entry].m_next;
+                place(entry);
+                entry = following;
+            }
+        }
+        for (int l = WHEELLEVELS - 1; l > 0; l--) {
+            if ((m_now & ((1LL << (WHEELBITS * l)) - 1)) == 0) {
+                int entry = takeSlot(l * WHEELSLOTS + (int)((m_now >> (WHEELBITS * l)) & (WHEELSLOTS - 1)));
+                while (entry != -1) {
+                    int following = m_entries[entry].m_next;
+                    place(entry);
+                    entry = following;
+                }
+            }
+        }
+        int entry = takeSlot((int)(m_now & (WHEELSLOTS - 1)));
+        while (entry != -1) {
+            int following = m_entries[entry].m_next;
+            due.push_back(m_entries[entry].m_order);
+            m_queue.withdraw(m_entries[entry].m_order); // bulkLoad counts it again
+            release(entry);
+            m_pending -= 1;
+            entry = following;
+        }
+    }
+    if (time > m_now) {
+        m_now = time;
+    }
+    if (!due.empty()) {
+        m_queue.bulkLoad(vector<vector<Order> >(1, due));
+    }
+    return (int)due.size();
+}
+long long TimingWheel::getTime() const {
+    return m_now;
+}
+int TimingWheel::numPending() const {
+    return m_pending;
+}
+// The lowest level whose current block holds the due time. Orders due at
+// m_now, which only happens while cascading, go to the current level 0 slot.
+void TimingWheel::place(int entry) {
+    Entry& e = m_entries[entry];
+    int slot = OVERFLOWSLOT;
+    for (int l = 0; l < WHEELLEVELS; l++) {
+        int shift = WHEELBITS * (l + 1);
+        if ((e.m_due >> shift) == (m_now >> shift)) {
+            int s = (int)((e.m_due >> (WHEELBITS * l)) & (WHEELSLOTS - 1));
+            slot = l * WHEELSLOTS + s;
+            m_occupied[l] |= 1ULL << s;
+            break;
+        }
+    }
+    e.m_slot = slot;
+    e.m_prev = -1;
+    e.m_next = m_heads[slot];
+    if (m_heads[slot] != -1) {
+        m_entries[m_heads[slot]].m_prev = entry;
+    }
+    m_heads[slot] = entry;
+}
+void TimingWheel::unlink(int entry) {
+    Entry& e = m_entries[entry];
+    if (e.m_prev != -1) {
+        m_entries[e.m_prev].m_next = e.m_next;
+    }
+    else {
+        m_heads[e.m_slot] = e.m_next;
+        if (e.m_next == -1 && e.m_slot != OVERFLOWSLOT) {
+            m_occupied[e.m_slot / WHEELSLOTS] &= ~(1ULL << (e.m_slot % WHEELSLOTS));
+        }
+    }
+    if (e.m_next != -1) {
+        m_entries[e.m_next].m_prev = e.m_prev;
+    }
+}
+void TimingWheel::release(int entry) {
+    m_entries[entry].m_slot = FREESLOT;
+    m_entries[entry].m_generation += 1;
+    m_entries[entry].m_next = m_free;
+    m_free = entry;
+}
+// the entries stay chained through m_next so the caller can walk them
+int TimingWheel::takeSlot(int slot) {
+    int first = m_heads[slot];
+    m_heads[slot] = -1;
+    if (slot != OVERFLOWSLOT) {
+        m_occupied[slot / WHEELSLOTS] &= ~(1ULL << (slot % WHEELSLOTS));
+    }
+    return first;
+}
+// Occupied slots always lie after the current slot of their level, so the
+// first set bit above it gives the tick the slot starts at.
+long long TimingWheel::nextEvent() const {
+    long long next = LLONG_MAX;
+    for (int l = 0; l < WHEELLEVELS; l++) {
+        int shift = WHEELBITS * l;
+        int current = (int)((m_now >> shift) & (WHEELSLOTS - 1));
+        unsigned long long later = current == WHEELSLOTS - 1 ? 0 : m_occupied[l] & (~0ULL << (current + 1));
+        if (later != 0) {
+            long long start = ((m_now >> shift) - current + __builtin_ctzll(later)) << shift;
+            if (start < next) {
+                next = start;
+            }
+        }
+    }
+    if (m_heads[OVERFLOWSLOT] != -1) {
+        int shift = WHEELBITS * WHEELLEVELS;
+        long long start = ((m_now >> shift) + 1) << shift;
+        if (start < next) {
+            next = start;
+        }
+    }
+    return next;
+}
@@ -0,0 +1,57 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+#include "cqueue.h"
+#include <climits>
+
+const int WHEELBITS = 6;                  // slots per level is 2^WHEELBITS
+const int WHEELSLOTS = 1 << WHEELBITS;
+const int WHEELLEVELS = 4;                // levels cover 2^24 ticks, later orders wait in an overflow list
+const long long NOHANDLE = -1;            // the order was not kept by the wheel
+
+class TimingWheel{
+    // Holds pre-orders until they are due, on a simulated clock of ticks.
+    // Level l has 64 slots of 64^l ticks each. An order sits in the lowest
+    // level whose current block contains its due time and moves down when
+    // the clock reaches its slot. Every slot is an intrusive doubly linked
+    // list, so schedule and cancel are O(1), and advancing jumps straight to
+    // the next occupied slot with the per-level occupancy masks. All orders
+    // that become due in one advance go into the queue as one bulkLoad, a
+    // heap built from the batch and melded in once.
+public:
+    explicit TimingWheel(CQueue& queue, long long now = 0);
+    ~TimingWheel(); // the pending orders no longer count against their customers
+    // Keeps the order until due and sets handle for cancel. The queue's
+    // admission runs now and the order counts toward its customer's limit
+    // while it waits. An order that is already due goes straight into the
+    // queue and handle is NOHANDLE, as it is for a rejected order.
+    ADMISSION schedule(const Order& order, long long due, long long& handle);
+    bool cancel(long long handle); // false if the order was released or cancelled already
+    int advance(long long ticks);  // returns the number of orders released
+    int advanceTo(long long time);
+    long long getTime() const;
+    int numPending() const;
+
+private:
+    struct Entry{
+        Order m_order;
+        long long m_due;
+        int m_prev;          // neighbours in the slot list, -1 at the ends
+        int m_next;          // next free entry while unused
+        int m_slot;          // level * WHEELSLOTS + slot, OVERFLOWSLOT or FREESLOT
+        unsigned int m_generation; // bumped on reuse so old handles fail
+    };
+    CQueue& m_queue;
+    long long m_now;
+    int m_pending;
+    vector<Entry> m_entries;
+    int m_free;                                  // first unused entry, -1 if none
+    int m_heads[WHEELLEVELS * WHEELSLOTS + 1];   // list heads, the last one is the overflow list
+    unsigned long long m_occupied[WHEELLEVELS];  // bit s set if slot s of the level is not empty
+
+    void place(int entry);        // links the entry into the slot for its due time
+    void unlink(int entry);
+    void release(int entry);      // back on the free list
+    int takeSlot(int slot);       // unlinks a whole slot, returns its first entry
+    long long nextEvent() const;  // next tick at which a slot comes due
+};
+#endif